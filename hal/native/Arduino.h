@@ -0,0 +1,42 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+// Subset of the Arduino core used by the firmware, see hal.cpp
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+// writes to stdout
+class HardwareSerial {
+public:
+	void begin(unsigned long baud);
+	int available();
+	int read();
+	int availableForWrite();
+	size_t write(uint8_t c);
+};
+
+extern HardwareSerial Serial;
+
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef EEPROM_H
+#define EEPROM_H
+#include <stdint.h>
+#include "hal.h"
+
+// backed by hal_eeprom[]
+struct EEPROMClass {
+	uint8_t read(int idx) { hal_eeprom_reads++; return hal_eeprom[idx]; }
+	void write(int idx, uint8_t val) { hal_eeprom_write(idx, val); }
+	void update(int idx, uint8_t val)
+	{
+		if (read(idx) != val)
+			hal_eeprom_write(idx, val);
+	}
+	uint16_t length() { return E2END + 1; }
+};
+
+static EEPROMClass EEPROM;
+
+#endif
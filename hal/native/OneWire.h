@@ -0,0 +1,23 @@
+#ifndef ONEWIRE_H
+#define ONEWIRE_H
+#include <stdint.h>
+
+// The part of the OneWire library used to search and configure the
+// sensors, talks to the virtual sensors in ow_native.cpp
+class OneWire {
+public:
+	OneWire(uint8_t pin) {}
+	uint8_t reset();
+	void select(const uint8_t rom[8]);
+	void skip();
+	void write(uint8_t v, uint8_t power = 0);
+	uint8_t read();
+	void reset_search();
+	bool search(uint8_t *newAddr);
+	static uint8_t crc8(const uint8_t *addr, uint8_t len);
+
+private:
+	uint8_t search_pos = 0;
+};
+
+#endif
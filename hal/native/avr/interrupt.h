@@ -0,0 +1,10 @@
+#ifndef HAL_AVR_INTERRUPT_H
+#define HAL_AVR_INTERRUPT_H
+// there are no interrupts on the host, the HAL runs the background work
+// synchronously in hal_advance_us()
+
+#define ISR(vector) extern "C" void vector(void)
+#define sei()
+#define cli()
+
+#endif
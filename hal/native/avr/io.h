@@ -0,0 +1,48 @@
+#ifndef HAL_AVR_IO_H
+#define HAL_AVR_IO_H
+// ATmega328 registers used by the firmware, plain variables on the host
+#include <stdint.h>
+
+#define RAMEND 0x8FF
+#define E2END 0x3FF
+
+extern volatile uint8_t SREG;
+
+// Timer1
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t TCNT1, OCR1A, OCR1B;
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define TOIE1 0
+#define OCIE1A 1
+#define OCIE1B 2
+#define TOV1 0
+#define OCF1A 1
+
+// Timer2, heater PWM
+extern volatile uint8_t TCCR2A, TCCR2B, TIMSK2, TIFR2, TCNT2, OCR2A, OCR2B;
+#define WGM20 0
+#define WGM21 1
+#define COM2B0 4
+#define COM2B1 5
+#define TOIE2 0
+#define TOV2 0
+
+// Port B, pin change interrupts
+extern volatile uint8_t PINB, PORTB, DDRB, PCICR, PCIFR, PCMSK0;
+#define PCIE0 0
+#define PCIF0 0
+
+// TWI
+extern volatile uint8_t TWBR, TWSR, TWDR, TWCR;
+#define TWINT 7
+#define TWEA 6
+#define TWSTA 5
+#define TWSTO 4
+#define TWWC 3
+#define TWEN 2
+#define TWIE 0
+
+#endif
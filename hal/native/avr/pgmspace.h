@@ -0,0 +1,17 @@
+#ifndef HAL_AVR_PGMSPACE_H
+#define HAL_AVR_PGMSPACE_H
+// flash and RAM share the address space on the host
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_ptr(p) (*(void * const *)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+#endif
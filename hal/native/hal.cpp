@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <Arduino.h>
+#include "hal.h"
+
+// i2c_native.cpp, ow_native.cpp
+void i2c_native_run();
+void ow_native_run();
+
+// firmware interrupt handlers, if there are any
+extern "C" void TIMER1_OVF_vect(void) __attribute__((weak));
+extern "C" void TIMER2_OVF_vect(void) __attribute__((weak));
+
+// --------------------------------------------------------------
+//  Registers
+// --------------------------------------------------------------
+volatile uint8_t SREG;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t TCNT1, OCR1A, OCR1B;
+volatile uint8_t TCCR2A, TCCR2B, TIMSK2, TIFR2, TCNT2, OCR2A, OCR2B;
+volatile uint8_t PINB, PORTB, DDRB, PCICR, PCIFR, PCMSK0;
+volatile uint8_t TWBR, TWSR, TWDR, TWCR;
+
+// --------------------------------------------------------------
+//  Time
+// --------------------------------------------------------------
+static uint64_t t_us = 0;
+
+void (*hal_tick_hook)(uint64_t t_us) = NULL;
+
+uint64_t hal_time_us()
+{
+	return t_us;
+}
+
+// Timer2 in phase correct PWM mode: 510 counts per period
+static uint32_t timer2_period_us()
+{
+	static const uint16_t prescale[] = {0, 1, 8, 32, 64, 128, 256, 1024};
+	return 510UL * prescale[TCCR2B & 7] / (F_CPU / 1000000UL);
+}
+
+static uint64_t t_ovf = 0;  // last Timer2 overflow
+
+static void timer2_run()
+{
+	if (!(TIMSK2 & (1 << TOIE2)) || !TIMER2_OVF_vect || !timer2_period_us()) {
+		t_ovf = t_us;
+		return;
+	}
+	while (t_ovf + timer2_period_us() <= t_us) {
+		t_ovf += timer2_period_us();
+		TIMER2_OVF_vect();
+	}
+}
+
+void hal_advance_us(uint32_t us)
+{
+	// the background work does not advance the time
+	static bool in_tick = false;
+	if (in_tick)
+		return;
+	in_tick = true;
+
+	// Timer1 free-running at F_CPU
+	uint64_t t1 = t_us * (F_CPU / 1000000UL);
+	t_us += us;
+	TCNT1 = t_us * (F_CPU / 1000000UL);
+	if ((TIMSK1 & (1 << TOIE1)) && TIMER1_OVF_vect)
+		for (uint64_t n=(t_us * (F_CPU / 1000000UL) >> 16) - (t1 >> 16); n; n--)
+			TIMER1_OVF_vect();
+
+	i2c_native_run();
+	ow_native_run();
+	timer2_run();
+
+	if (hal_tick_hook)
+		hal_tick_hook(t_us);
+
+	in_tick = false;
+}
+
+void hal_set_time_us(uint64_t us)
+{
+	if (us <= t_us)
+		return;
+	t_us = t_ovf = us;
+	TCNT1 = t_us * (F_CPU / 1000000UL);
+}
+
+// truncated to 32 bit, to wrap like on the target
+unsigned long millis()
+{
+	return (uint32_t)(t_us / 1000);
+}
+
+unsigned long micros()
+{
+	return (uint32_t)t_us;
+}
+
+void delay(unsigned long ms)
+{
+	hal_advance_us(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	hal_advance_us(us);
+}
+
+// --------------------------------------------------------------
+//  GPIO
+// --------------------------------------------------------------
+uint8_t hal_pin[HAL_N_PINS];
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	if (pin < HAL_N_PINS && mode == INPUT_PULLUP)
+		hal_pin[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+	if (pin < HAL_N_PINS)
+		hal_pin[pin] = val ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin)
+{
+	return pin < HAL_N_PINS ? hal_pin[pin] : LOW;
+}
+
+int analogRead(uint8_t pin)
+{
+	return rand() & 0x3FF;
+}
+
+// --------------------------------------------------------------
+//  Serial
+// --------------------------------------------------------------
+HardwareSerial Serial;
+
+FILE *hal_serial_out = stdout;
+
+static char rx_buf[64];
+static uint8_t rx_head = 0, rx_tail = 0;
+
+void hal_serial_input(const char *s)
+{
+	while (*s) {
+		uint8_t next = (rx_head + 1) % sizeof(rx_buf);
+		if (next == rx_tail)
+			return;
+		rx_buf[rx_head] = *s++;
+		rx_head = next;
+	}
+}
+
+// The transmitter drains the 63 byte buffer of the Arduino core at one
+// byte per 10 bit times, 0: before begin(), instantly
+static uint32_t byte_us = 0;
+// when the last queued byte is sent
+static uint64_t tx_done_us = 0;
+
+#define TX_BUF_SIZE 63
+
+static uint32_t tx_queued()
+{
+	if (!byte_us || tx_done_us <= t_us)
+		return 0;
+	return (tx_done_us - t_us + byte_us - 1) / byte_us;
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+	byte_us = (10000000UL + baud - 1) / baud;
+}
+
+int HardwareSerial::available()
+{
+	return (rx_head - rx_tail + sizeof(rx_buf)) % sizeof(rx_buf);
+}
+
+int HardwareSerial::read()
+{
+	if (rx_head == rx_tail)
+		return -1;
+	char c = rx_buf[rx_tail];
+	rx_tail = (rx_tail + 1) % sizeof(rx_buf);
+	return c;
+}
+
+int HardwareSerial::availableForWrite()
+{
+	return TX_BUF_SIZE - tx_queued();
+}
+
+// blocks while the buffer is full, like the Arduino core
+size_t HardwareSerial::write(uint8_t c)
+{
+	if (tx_queued() >= TX_BUF_SIZE)
+		hal_advance_us(tx_done_us - t_us - (TX_BUF_SIZE - 1) * byte_us);
+	if (tx_done_us < t_us)
+		tx_done_us = t_us;
+	tx_done_us += byte_us;
+
+	if (hal_serial_out)
+		fputc(c, hal_serial_out);
+	return 1;
+}
+
+// --------------------------------------------------------------
+//  EEPROM
+// --------------------------------------------------------------
+uint8_t hal_eeprom[E2END + 1];
+uint32_t hal_eeprom_reads = 0, hal_eeprom_writes = 0;
+uint32_t hal_eeprom_cut = UINT32_MAX;
+uint8_t hal_eeprom_torn = 0xFF;
+
+void hal_eeprom_write(int idx, uint8_t val)
+{
+	uint32_t n = hal_eeprom_writes++;
+	if (n < hal_eeprom_cut)
+		hal_eeprom[idx] = val;
+	else if (n == hal_eeprom_cut)
+		hal_eeprom[idx] = hal_eeprom_torn;
+}
+
+// before main(), the simulator may load its own content
+__attribute__((constructor)) static void eeprom_erase()
+{
+	memset(hal_eeprom, 0xFF, sizeof(hal_eeprom));
+}
+
+// --------------------------------------------------------------
+//  Main
+// --------------------------------------------------------------
+void hal_run(uint32_t ms)
+{
+	setup();
+
+	uint64_t t_end = t_us + ms * 1000ULL;
+	while (ms == 0 || t_us < t_end) {
+		loop();
+		hal_advance_us(HAL_LOOP_US);
+	}
+}
+
+// usage: ./program [seconds of virtual time to run]
+// replaced by the simulator, which provides its own main()
+__attribute__((weak)) int main(int argc, char **argv)
+{
+	hal_run(argc > 1 ? atol(argv[1]) * 1000 : 0);
+	fflush(stdout);
+	return 0;
+}
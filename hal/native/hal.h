@@ -0,0 +1,74 @@
+#ifndef HAL_H
+#define HAL_H
+#include <stdint.h>
+#include <stdio.h>
+#include <avr/io.h>
+
+// Host side of the native HAL, to drive the firmware from a simulator.
+// Time is virtual: it only advances in delay(), busy waiting on the
+// background transfers and between two calls of loop().
+
+// time advanced between two calls of loop() [us]
+#define HAL_LOOP_US 100
+
+// Advance the virtual time. Queued I2C and 1-wire transactions complete
+// and the Timer2 overflow interrupt runs once per PWM period, then
+// hal_tick_hook is called, this is what the interrupts did.
+void hal_advance_us(uint32_t us);
+
+// Called with the virtual time whenever it advances (plant models)
+extern void (*hal_tick_hook)(uint64_t t_us);
+
+// Virtual time since reset [us]
+uint64_t hal_time_us();
+
+// Jump ahead to `us` without running the interrupts in between, e.g. to
+// just before the millis() overflow after 49 days
+void hal_set_time_us(uint64_t us);
+
+// setup(), then loop() for `ms` of virtual time, forever if ms == 0
+void hal_run(uint32_t ms);
+
+// Digital pin levels, written by digitalWrite() or the simulator
+#define HAL_N_PINS 20
+extern uint8_t hal_pin[HAL_N_PINS];
+
+// Queue characters to be read from Serial
+void hal_serial_input(const char *s);
+
+// Serial output goes here, stdout by default, NULL discards it. It drains
+// at the baud rate of Serial.begin(): availableForWrite() counts down and
+// write() to the full buffer waits, i.e. advances the time.
+extern FILE *hal_serial_out;
+
+// EEPROM content, erased (0xFF) on start-up
+extern uint8_t hal_eeprom[E2END + 1];
+// bytes read and written, update() only writes the bytes which change
+extern uint32_t hal_eeprom_reads, hal_eeprom_writes;
+// Power loss emulation: write number hal_eeprom_cut (counted like
+// hal_eeprom_writes) is torn, the byte reads hal_eeprom_torn, and all
+// later writes are lost. UINT32_MAX: the power stays on.
+extern uint32_t hal_eeprom_cut;
+extern uint8_t hal_eeprom_torn;
+void hal_eeprom_write(int idx, uint8_t val);
+
+// 1-wire temperature sensors, found in this order by the ROM search
+#define HAL_N_OW 2
+extern uint8_t hal_ow_n;
+// temperature [degC] with nFract = 4, latched by the next CONVERT T
+extern int16_t hal_ow_temp[HAL_N_OW];
+// The next CONVERT T of sensor i browns it out: the scratchpad returns to
+// its power-on content (85 degC) instead of the temperature
+void hal_ow_brownout(uint8_t i);
+// the next n transactions end with OW_LATE, as if a read slot was sampled
+// too late
+extern uint8_t hal_ow_late;
+
+// SSD1306 display RAM as written over I2C
+extern uint8_t hal_gddram[8][128];
+extern bool hal_ssd_inverted;
+
+// Draw the display RAM as text
+void hal_ssd_dump(FILE *f);
+
+#endif
@@ -0,0 +1,245 @@
+// Replaces i2cmaster.cpp on the host: the transactions go to a model of
+// the SSD1306 display RAM (horizontal addressing mode only).
+#include <stdio.h>
+#include <i2cmaster.h>
+#include "hal.h"
+
+#define SSD_ADDR 0x3C
+#define N_PAGES 8
+#define WIDTH 128
+
+uint8_t hal_gddram[N_PAGES][WIDTH];
+bool hal_ssd_inverted = false;
+
+// --------------------------------------------------------------
+//  SSD1306 model
+// --------------------------------------------------------------
+static bool ctrl_next;  // next byte is a control byte
+static bool ctrl_co;  // only one byte follows the control byte
+static bool ctrl_data;
+
+static uint8_t cmd_buf[8];
+static uint8_t cmd_len, cmd_args;
+
+static uint8_t col_start = 0, col_end = WIDTH - 1, col = 0;
+static uint8_t page_start = 0, page_end = N_PAGES - 1, page = 0;
+
+// number of argument bytes following a command
+static uint8_t n_args(uint8_t c)
+{
+	switch (c) {
+	case 0x21:  // column address
+	case 0x22:  // page address
+	case 0xA3:  // vertical scroll area
+		return 2;
+	case 0x26:  // horizontal scroll
+	case 0x27:
+	case 0x2C:  // content scroll, one column
+	case 0x2D:
+		return 6;
+	case 0x29:  // vertical and horizontal scroll
+	case 0x2A:
+		return 5;
+	case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3:
+	case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+		return 1;
+	}
+	return 0;
+}
+
+// columns x0 .. x1 of pages p0 .. p1 move by one, towards x0 if left.
+// The column moving out comes back in on the other side.
+static void content_scroll(bool left, uint8_t p0, uint8_t p1, uint8_t x0, uint8_t x1)
+{
+	if (x1 <= x0)
+		return;
+	for (uint8_t p=p0; p<=p1; p++) {
+		uint8_t *r = hal_gddram[p];
+		if (left) {
+			uint8_t b = r[x0];
+			for (uint8_t x=x0; x<x1; x++)
+				r[x] = r[x + 1];
+			r[x1] = b;
+		} else {
+			uint8_t b = r[x1];
+			for (uint8_t x=x1; x>x0; x--)
+				r[x] = r[x - 1];
+			r[x0] = b;
+		}
+	}
+}
+
+static void ssd_cmd()
+{
+	switch (cmd_buf[0]) {
+	case 0x21:
+		col_start = col = cmd_buf[1] % WIDTH;
+		col_end = cmd_buf[2] % WIDTH;
+		break;
+	case 0x22:
+		page_start = page = cmd_buf[1] % N_PAGES;
+		page_end = cmd_buf[2] % N_PAGES;
+		break;
+	case 0x2C:
+	case 0x2D:
+		content_scroll(cmd_buf[0] & 1, cmd_buf[2] % N_PAGES,
+			cmd_buf[4] % N_PAGES, cmd_buf[5] % WIDTH, cmd_buf[6] % WIDTH);
+		break;
+	case 0xA6:
+	case 0xA7:
+		hal_ssd_inverted = cmd_buf[0] & 1;
+		break;
+	}
+}
+
+static void ssd_start()
+{
+	ctrl_next = true;
+}
+
+static void ssd_byte(uint8_t b)
+{
+	if (ctrl_next) {
+		ctrl_co = b & 0x80;
+		ctrl_data = b & 0x40;
+		ctrl_next = false;
+		return;
+	}
+
+	if (ctrl_data) {
+		hal_gddram[page][col] = b;
+		if (col++ >= col_end) {
+			col = col_start;
+			if (page++ >= page_end)
+				page = page_start;
+		}
+	} else {
+		if (cmd_len == 0)
+			cmd_args = n_args(b);
+		cmd_buf[cmd_len++] = b;
+		if (cmd_len > cmd_args) {
+			ssd_cmd();
+			cmd_len = 0;
+		}
+	}
+
+	if (ctrl_co)
+		ctrl_next = true;
+}
+
+void hal_ssd_dump(FILE *f)
+{
+	for (uint8_t y=0; y<N_PAGES * 8; y += 2) {
+		for (uint8_t x=0; x<WIDTH; x++) {
+			uint8_t b = hal_gddram[y / 8][x] >> (y % 8);
+			bool top = (b & 1) ^ hal_ssd_inverted;
+			bool bot = ((b >> 1) & 1) ^ hal_ssd_inverted;
+			fputs(top ? (bot ? "█" : "▀") : (bot ? "▄" : " "), f);
+		}
+		fputc('\n', f);
+	}
+}
+
+// --------------------------------------------------------------
+//  Blocking API
+// --------------------------------------------------------------
+static bool selected = false;
+
+void i2c_init(void)
+{
+}
+
+unsigned char i2c_start(unsigned char addr)
+{
+	i2c_wait_idle();
+	selected = (addr >> 1) == SSD_ADDR && (addr & I2C_READ) == I2C_WRITE;
+	if (selected)
+		ssd_start();
+	return selected ? 0 : 1;
+}
+
+unsigned char i2c_rep_start(unsigned char addr)
+{
+	return i2c_start(addr);
+}
+
+void i2c_start_wait(unsigned char addr)
+{
+	i2c_start(addr);
+}
+
+void i2c_stop(void)
+{
+	selected = false;
+}
+
+unsigned char i2c_write(unsigned char data)
+{
+	if (!selected)
+		return 1;
+	ssd_byte(data);
+	return 0;
+}
+
+unsigned char i2c_readAck(void)
+{
+	return 0xFF;
+}
+
+unsigned char i2c_readNak(void)
+{
+	return 0xFF;
+}
+
+// --------------------------------------------------------------
+//  Queued transactions
+// --------------------------------------------------------------
+static struct i2c_xfer *queue[I2C_QUEUE_LEN];
+static uint8_t q_head = 0, q_tail = 0;
+
+unsigned char i2c_queue(struct i2c_xfer *x)
+{
+	uint8_t next = (q_head + 1) % I2C_QUEUE_LEN;
+	if (next == q_tail)
+		return 1;
+	x->status = I2C_XF_BUSY;
+	queue[q_head] = x;
+	q_head = next;
+	return 0;
+}
+
+// called by hal_advance_us(), in place of the TWI interrupt
+void i2c_native_run()
+{
+	while (q_tail != q_head) {
+		struct i2c_xfer *x = queue[q_tail];
+		q_tail = (q_tail + 1) % I2C_QUEUE_LEN;
+
+		uint8_t status = 1;
+		if ((x->addr >> 1) == SSD_ADDR) {
+			ssd_start();
+			if (x->flags & I2C_XF_PREFIX)
+				ssd_byte(x->prefix);
+			for (unsigned i=0; i<x->len; i++)
+				ssd_byte(x->buf[i]);
+			status = 0;
+		}
+
+		x->status = status;
+		// may queue the next transaction
+		if (x->done)
+			x->done(status);
+	}
+}
+
+unsigned char i2c_busy(void)
+{
+	if (q_tail != q_head)
+		hal_advance_us(10);
+	return q_tail != q_head;
+}
+
+void i2c_wait_idle(void)
+{
+	while (i2c_busy());
+}
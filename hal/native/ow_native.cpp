@@ -0,0 +1,236 @@
+// Replaces ow_timer.cpp on the host: the transactions are answered by
+// models of DS18B20 sensors.
+#include <string.h>
+#include <OneWire.h>
+#include "ow_timer.h"
+#include "crc.h"
+#include "hal.h"
+
+uint8_t hal_ow_n = HAL_N_OW;
+uint8_t hal_ow_late = 0;
+int16_t hal_ow_temp[HAL_N_OW] = {25 << 4, 25 << 4};
+
+// power-on value of the temperature register: 85 degC
+#define T_RESET (85 << 4)
+
+static uint8_t scratch[HAL_N_OW][9];
+static bool scratch_init = false;
+static bool brownout[HAL_N_OW];
+
+#define ALL 0xFF
+#define NONE 0xFE
+
+static void rom(uint8_t i, uint8_t *addr)
+{
+	addr[0] = 0x28;  // DS18B20
+	for (uint8_t k=1; k<7; k++)
+		addr[k] = 0x10 * k + i;
+	addr[7] = crc8(addr, 7);
+}
+
+// returns the sensor index
+static uint8_t match_rom(const uint8_t *addr)
+{
+	uint8_t tmp[8];
+	for (uint8_t i=0; i<hal_ow_n; i++) {
+		rom(i, tmp);
+		if (memcmp(tmp, addr, 8) == 0)
+			return i;
+	}
+	return NONE;
+}
+
+static void set_temp(uint8_t i, int16_t t)
+{
+	scratch[i][0] = t & 0xFF;
+	scratch[i][1] = t >> 8;
+	scratch[i][8] = crc8(scratch[i], 8);
+}
+
+static void power_on(uint8_t i)
+{
+	uint8_t def[9] = {0, 0, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0};
+	memcpy(scratch[i], def, 9);
+	set_temp(i, T_RESET);
+}
+
+static void init_scratch()
+{
+	if (scratch_init)
+		return;
+	for (uint8_t i=0; i<HAL_N_OW; i++)
+		power_on(i);
+	scratch_init = true;
+}
+
+void hal_ow_brownout(uint8_t i)
+{
+	brownout[i] = true;
+}
+
+// state of the current transaction
+static uint8_t sel;  // selected sensor, ALL or NONE
+static uint8_t n_written;
+static uint8_t n_rom;  // length of the ROM command
+static uint8_t func;  // function command
+static uint8_t rd_pos;
+
+static void bus_reset()
+{
+	init_scratch();
+	sel = NONE;
+	n_written = 0;
+	n_rom = 1;
+	func = 0;
+	rd_pos = 0;
+}
+
+static void bus_write(uint8_t b)
+{
+	static uint8_t addr[8];
+	uint8_t n = n_written++;
+
+	if (n == 0) {
+		// SKIP ROM or MATCH ROM
+		if (b == 0xCC)
+			sel = ALL;
+		else if (b == 0x55)
+			n_rom = 9;
+	} else if (n < n_rom) {
+		addr[n - 1] = b;
+		if (n == 8)
+			sel = match_rom(addr);
+	} else if (n == n_rom) {
+		func = b;
+	} else if (func == 0x4E && n - n_rom <= 3) {
+		// WRITE SCRATCHPAD: TH, TL, config
+		for (uint8_t i=0; i<hal_ow_n; i++) {
+			if (sel == ALL || sel == i) {
+				scratch[i][1 + n - n_rom] = b;
+				scratch[i][8] = crc8(scratch[i], 8);
+			}
+		}
+	}
+
+	// CONVERT T, done instantly
+	if (n == n_rom && func == 0x44)
+		for (uint8_t i=0; i<hal_ow_n; i++)
+			if (sel == ALL || sel == i) {
+				if (brownout[i])
+					power_on(i);
+				else
+					set_temp(i, hal_ow_temp[i]);
+				brownout[i] = false;
+			}
+}
+
+
+static uint8_t bus_read()
+{
+	if (func == 0xBE && sel < hal_ow_n && rd_pos < 9)
+		return scratch[sel][rd_pos++];
+	return 0xFF;
+}
+
+// --------------------------------------------------------------
+//  Transaction engine, see ow_timer.h
+// --------------------------------------------------------------
+static struct ow_xfer *queue[OW_QUEUE_LEN];
+static uint8_t q_head = 0, q_tail = 0;
+
+void ow_init()
+{
+}
+
+uint8_t ow_queue(struct ow_xfer *x)
+{
+	uint8_t next = (q_head + 1) % OW_QUEUE_LEN;
+	if (next == q_tail)
+		return 1;
+	x->status = OW_BUSY;
+	queue[q_head] = x;
+	q_head = next;
+	return 0;
+}
+
+// called by hal_advance_us(), in place of the Timer1 interrupt
+void ow_native_run()
+{
+	while (q_tail != q_head) {
+		struct ow_xfer *x = queue[q_tail];
+		q_tail = (q_tail + 1) % OW_QUEUE_LEN;
+
+		if (hal_ow_n == 0) {
+			x->status = OW_NO_PRESENCE;
+			continue;
+		}
+		if (hal_ow_late) {
+			hal_ow_late--;
+			x->status = OW_LATE;
+			continue;
+		}
+
+		bus_reset();
+		for (uint8_t i=0; i<x->n_tx; i++)
+			bus_write(x->tx[i]);
+		for (uint8_t i=0; i<x->n_rx; i++)
+			x->rx[i] = bus_read();
+		x->status = OW_OK;
+	}
+}
+
+bool ow_busy()
+{
+	if (q_tail != q_head)
+		hal_advance_us(10);
+	return q_tail != q_head;
+}
+
+// --------------------------------------------------------------
+//  OneWire library
+// --------------------------------------------------------------
+uint8_t OneWire::reset()
+{
+	bus_reset();
+	return hal_ow_n > 0;
+}
+
+void OneWire::select(const uint8_t rom[8])
+{
+	bus_write(0x55);
+	for (uint8_t i=0; i<8; i++)
+		bus_write(rom[i]);
+}
+
+void OneWire::skip()
+{
+	bus_write(0xCC);
+}
+
+void OneWire::write(uint8_t v, uint8_t power)
+{
+	bus_write(v);
+}
+
+uint8_t OneWire::read()
+{
+	return bus_read();
+}
+
+void OneWire::reset_search()
+{
+	search_pos = 0;
+}
+
+bool OneWire::search(uint8_t *newAddr)
+{
+	if (search_pos >= hal_ow_n)
+		return false;
+	rom(search_pos++, newAddr);
+	return true;
+}
+
+uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len)
+{
+	return ::crc8(addr, len);
+}
@@ -0,0 +1,13 @@
+// Replaces sram.cpp on the host: there is no AVR stack to watch
+#include "sram.h"
+#include "print.h"
+
+uint16_t sram_check()
+{
+	return 0xFFFF;
+}
+
+void sram_print()
+{
+	print_str("sram not measured on the host\n");
+}
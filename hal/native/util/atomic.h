@@ -0,0 +1,9 @@
+#ifndef HAL_UTIL_ATOMIC_H
+#define HAL_UTIL_ATOMIC_H
+// nothing interrupts the firmware on the host
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) for (uint8_t _done = 0; !_done; _done = 1)
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef HAL_UTIL_DELAY_H
+#define HAL_UTIL_DELAY_H
+#include "hal.h"
+
+#define _delay_us(us) hal_advance_us(us)
+#define _delay_ms(ms) hal_advance_us((ms) * 1000UL)
+
+#endif
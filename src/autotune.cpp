@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include "autotune.h"
+#include "pid.h"
+#include "print.h"
+#include "uart_log.h"
+
+// relay output amplitude
+#define RELAY_D ((POWER_MAX_LIMIT - POWER_MIN_LIMIT) / 2)
+
+static bool active = false;
+static bool relay_on;
+static int16_t set;
+
+static uint16_t cycles;  // since start
+static uint16_t t_on;  // last switch-on
+static int16_t t_min, t_max;  // extremes of the current half period
+
+static uint8_t n_periods;
+static uint16_t sum_period;  // [cycles]
+static int32_t sum_amp;  // peak to peak
+
+void autotune_start()
+{
+	set = limit(target_air_temperature.raw, AIR_MIN_LIMIT, AIR_MAX_LIMIT - AT_MARGIN);
+	relay_on = true;
+	cycles = 0;
+	t_on = 0;
+	t_min = 0x7FFF;
+	t_max = -0x7FFF;
+	n_periods = 0;
+	sum_period = 0;
+	sum_amp = 0;
+	active = true;
+
+	log_prio(LOG_ERR);
+	print_str_P(PSTR("autotune start at "));
+	print_dec_fix(set, FP_FRAC, 1);
+	print_str_P(PSTR("\n"));
+	log_prio(LOG_INFO);
+}
+
+void autotune_abort()
+{
+	if (!active)
+		return;
+	active = false;
+
+	log_prio(LOG_ERR);
+	print_str_P(PSTR("autotune aborted\n"));
+	log_prio(LOG_INFO);
+}
+
+bool autotune_active()
+{
+	return active;
+}
+
+// floor(sqrt(v))
+static uint16_t isqrt(uint32_t v)
+{
+	uint32_t r = 0, b = 1UL << 30;
+	while (b > v)
+		b >>= 2;
+	while (b) {
+		if (v >= r + b) {
+			v -= r + b;
+			r = (r >> 1) + b;
+		} else {
+			r >>= 1;
+		}
+		b >>= 2;
+	}
+	return r;
+}
+
+static void finish()
+{
+	active = false;
+
+	// peak amplitude and period [cycles]
+	int32_t a = sum_amp / (2 * AT_N_PERIODS);
+	int32_t tu = sum_period / AT_N_PERIODS;
+	// the hysteresis h moves the oscillation off the negative real axis,
+	// -1 / N(a) = -pi / (4 * d) * (sqrt(a^2 - h^2) + j * h). The real part
+	// is where the loop gain is -1
+	int32_t a2 = a * a - AT_HYST * AT_HYST;
+	if (a <= 0 || a2 <= 0 || tu <= 0) {
+		autotune_abort();
+		return;
+	}
+	// sqrt(a^2 - h^2) with 4 more fractional bits
+	int32_t b = isqrt((uint32_t)a2 << 8);
+
+	// ultimate gain 4 * d / (pi * b), pi ~ 355 / 113
+	int32_t ku = 4 * RELAY_D * FP_SCALE * 113 / 355 * 16 / b;
+
+	// Ziegler-Nichols PI: kp = 0.45 ku, ti = tu / 1.2
+	int32_t kp = ku * 45 / 100;
+	int32_t ki = ku * 54 / (100 * tu);
+	if (kp < 1)
+		kp = 1;
+
+	pid_set_air_gains(kp, ki);
+
+	log_prio(LOG_ERR);
+	print_str_P(PSTR("autotune ku "));
+	print_dec_fix(ku, FP_FRAC, 1);
+	print_str_P(PSTR(" tu "));
+	print_dec(tu);
+	print_str_P(PSTR(", kp "));
+	print_dec_fix(kp, FP_FRAC, 2);
+	print_str_P(PSTR(" ki "));
+	print_dec_fix(ki, FP_FRAC, 2);
+	print_str_P(PSTR("\n"));
+	log_prio(LOG_INFO);
+}
+
+int16_t autotune_step(int16_t temp)
+{
+	cycles++;
+
+	if (temp > AIR_MAX_LIMIT || cycles > AT_TIMEOUT) {
+		autotune_abort();
+		return POWER_MIN_LIMIT;
+	}
+
+	if (temp < t_min) t_min = temp;
+	if (temp > t_max) t_max = temp;
+
+	if (relay_on && temp > set + AT_HYST) {
+		// the minimum of the on phase is known now
+		relay_on = false;
+		t_max = temp;
+	} else if (!relay_on && temp < set - AT_HYST) {
+		// one full period, the first one starts from off the set-point
+		if (n_periods > 0) {
+			sum_period += cycles - t_on;
+			sum_amp += t_max - t_min;
+		}
+		n_periods++;
+
+		relay_on = true;
+		t_on = cycles;
+		t_min = temp;
+
+		if (n_periods > AT_N_PERIODS) {
+			finish();
+			return POWER_MIN_LIMIT;
+		}
+	}
+
+	return relay_on ? POWER_MAX_LIMIT : POWER_MIN_LIMIT;
+}
@@ -0,0 +1,38 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+#include <stdint.h>
+
+// Relay feedback auto-tuning of the air temperature loop (Astrom-Hagglund).
+// The heater is switched between POWER_MIN_LIMIT and POWER_MAX_LIMIT
+// around the air set-point. From the amplitude and period of the
+// resulting oscillation the ultimate gain and period are identified and
+// new PI gains are computed (Ziegler-Nichols) and stored in EEPROM.
+// On a box with a short dead time the oscillation is slower than the
+// ultimate period: tu comes out long and ku low, by up to 2.6x on the
+// plants of test_autotune.cpp. The gains are conservative.
+
+// Relay hysteresis, must be larger than the sensor noise [degC]. The
+// ultimate gain is corrected for it
+#define AT_HYST FP(0.2)
+
+// Number of oscillation periods to average, the first one is ignored
+#define AT_N_PERIODS 3
+
+// Give up after this many control cycles
+#define AT_TIMEOUT 7200
+
+// Air set-point during the experiment is limited to AIR_MAX_LIMIT - this
+#define AT_MARGIN FP(2.0)
+
+// Start the experiment around the current air set-point
+void autotune_start();
+
+// Stop the experiment, the gains are unchanged
+void autotune_abort();
+
+bool autotune_active();
+
+// Call this once per control cycle while active, returns heater power
+int16_t autotune_step(int16_t temp);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef CRC_H
+#define CRC_H
+#include <stdint.h>
+
+// Dallas / Maxim CRC8 (table driven), of the 1-wire ROM codes and
+// scratchpads and of the EEPROM records
+uint8_t crc8(const uint8_t *p, uint8_t len);
+
+#endif
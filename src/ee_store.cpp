@@ -0,0 +1,179 @@
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <EEPROM.h>
+#include "ee_store.h"
+#include "crc.h"
+#include "print.h"
+#include "prof.h"
+
+#define REC_SIZE 8
+#define N_RECS ((E2END + 1) / REC_SIZE)
+#define NONE 0xFF
+
+// record layout
+#define REC_KEY 0
+#define REC_SEQ 1  // 16 bit
+#define REC_VAL 3  // 32 bit
+#define REC_CRC 7  // over the first 7 bytes, written last
+
+// newest record of each key
+static uint8_t live_pos[EE_N_KEYS];
+static uint16_t live_seq[EE_N_KEYS];
+static int32_t live_val[EE_N_KEYS];
+
+// next slot to write and sequence number of the last record
+static uint8_t head = 0;
+static uint16_t seq = 0;
+
+// serial number arithmetic, true if a is newer than b
+static bool newer(uint16_t a, uint16_t b)
+{
+	return (int16_t)(a - b) > 0;
+}
+
+// returns false if the record in slot `pos` is invalid
+static bool read_rec(uint8_t pos, uint8_t *key, uint16_t *s, int32_t *val)
+{
+	uint8_t rec[REC_SIZE];
+	for (uint8_t i=0; i<REC_SIZE; i++)
+		rec[i] = EEPROM.read(pos * REC_SIZE + i);
+
+	// erased EEPROM reads 0xFF
+	if (rec[REC_KEY] >= EE_N_KEYS || crc8(rec, REC_CRC) != rec[REC_CRC])
+		return false;
+
+	*key = rec[REC_KEY];
+	*s = rec[REC_SEQ] | (rec[REC_SEQ + 1] << 8);
+	*val = 0;
+	for (uint8_t i=0; i<4; i++)
+		*val |= (int32_t)rec[REC_VAL + i] << (i * 8);
+	return true;
+}
+
+static void write_rec(uint8_t pos, uint8_t key, uint16_t s, int32_t val)
+{
+	uint8_t rec[REC_SIZE];
+	rec[REC_KEY] = key;
+	rec[REC_SEQ] = s & 0xFF;
+	rec[REC_SEQ + 1] = s >> 8;
+	for (uint8_t i=0; i<4; i++)
+		rec[REC_VAL + i] = val >> (i * 8);
+	rec[REC_CRC] = crc8(rec, REC_CRC);
+
+	// CRC goes last, a record torn by a power loss stays invalid
+	for (uint8_t i=0; i<REC_SIZE; i++)
+		EEPROM.update(pos * REC_SIZE + i, rec[i]);
+}
+
+static bool is_live(uint8_t pos)
+{
+	for (uint8_t k=0; k<EE_N_KEYS; k++)
+		if (live_pos[k] == pos)
+			return true;
+	return false;
+}
+
+static void append(uint8_t key, int32_t val)
+{
+	// the newest record of a key is never overwritten
+	while (is_live(head))
+		head = (head + 1) % N_RECS;
+
+	seq++;
+	write_rec(head, key, seq, val);
+	live_pos[key] = head;
+	live_seq[key] = seq;
+	live_val[key] = val;
+	head = (head + 1) % N_RECS;
+}
+
+// Values of the old fixed slot format: 4 bytes + checksum at slot << 3
+static void migrate()
+{
+	for (uint8_t slot=0; slot<=SL_HATCH_POS; slot++) {
+		int32_t tmp = 0;
+		uint8_t sum = 0;
+		for (uint8_t i=0; i<=3; i++) {
+			uint8_t r = EEPROM.read((3 - i) + (slot << 3));
+			sum += r;
+			tmp <<= 8;
+			tmp |= r;
+		}
+		if (EEPROM.read(4 + (slot << 3)) == sum)
+			append(slot, tmp);
+	}
+}
+
+void ee_init()
+{
+	bool found = false;
+
+	for (uint8_t k=0; k<EE_N_KEYS; k++)
+		live_pos[k] = NONE;
+
+	for (uint8_t pos=0; pos<N_RECS; pos++) {
+		uint8_t key;
+		uint16_t s;
+		int32_t val;
+
+		if (!read_rec(pos, &key, &s, &val))
+			continue;
+
+		if (live_pos[key] == NONE || newer(s, live_seq[key])) {
+			live_pos[key] = pos;
+			live_seq[key] = s;
+			live_val[key] = val;
+		}
+
+		// continue after the newest record
+		if (!found || newer(s, seq)) {
+			seq = s;
+			head = (pos + 1) % N_RECS;
+			found = true;
+		}
+	}
+
+	if (!found) {
+		print_str_P(PSTR("EEPROM empty, migrating\n"));
+		migrate();
+	}
+}
+
+void store_ee(int32_t val, uint8_t slot)
+{
+	if (slot >= EE_N_KEYS)
+		return;
+
+	if (live_pos[slot] != NONE && live_val[slot] == val)
+		return;
+
+	// only the writes
+	PROF_SCOPE(PROF_EE);
+
+	append(slot, val);
+
+	// re-write records which have not changed for a long time
+	for (uint8_t k=0; k<EE_N_KEYS; k++)
+		if (live_pos[k] != NONE && (uint16_t)(seq - live_seq[k]) > EE_MAX_AGE)
+			append(k, live_val[k]);
+
+	print_str_P(PSTR("stored "));
+	print_udec(slot);
+	print_str_P(PSTR("\n"));
+}
+
+bool load_ee(int32_t *val, uint8_t slot)
+{
+	if (slot < EE_N_KEYS && live_pos[slot] != NONE) {
+		*val = live_val[slot];
+		print_str_P(PSTR("restored "));
+		print_udec(slot);
+		print_str_P(PSTR("\n"));
+		return true;
+	}
+	print_str_P(PSTR("EEPROM read "));
+	print_udec(slot);
+	print_str_P(PSTR(" failed\n"));
+	return false;
+}
@@ -0,0 +1,35 @@
+#ifndef EE_STORE_H
+#define EE_STORE_H
+#include <stdint.h>
+
+// Log structured, wear leveled store for a few 32 bit values.
+// Every store appends an 8 byte record (key, sequence number, value,
+// CRC8) to the next free slot of a ring over the whole EEPROM. At boot,
+// the record with the highest sequence number of each key wins.
+
+// used EEPROM keys
+enum EE_SLOTS {
+	SL_T_SET,
+	SL_I_VAL,
+	SL_MS_SINCE_START,
+	SL_I_VAL_AIR,
+	SL_HATCH_POS,
+	SL_AIR_KP,
+	SL_AIR_KI,
+	EE_N_KEYS
+};
+
+// Records older than this [stores] are re-written, keeps all valid
+// sequence numbers within a window where comparing them is unambiguous
+#define EE_MAX_AGE 0x2000
+
+// Scan the EEPROM, call this once before load_ee()
+void ee_init();
+
+// Store 32 bit value into EEPROM, nothing is written if it is unchanged
+void store_ee(int32_t val, uint8_t slot);
+
+// load 32 bit value from EEPROM, returns true on success
+bool load_ee(int32_t *val, uint8_t slot);
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef FILTER_H
+#define FILTER_H
+#include <stdint.h>
+#include "fixed.h"
+
+// Per sensor filter pipeline, composed at compile time:
+//
+//   pipeline<drop_value<fp16, FP(85.0)>, median3<fp16, FP(0.5)>,
+//            moving_avg<fp16, 4> > f;
+//   if (f(x)) ... x is the filtered sample
+//
+// Every stage works in place on one sample in O(1) and returns false if
+// the sample is dropped, then the later stages don't see it and the
+// caller keeps its last output. Stages count the samples they rejected
+// or modified in `rejected`.
+
+// Drops every sample equal to V (raw), like the DS18B20 power-on value
+// (85.0 degC), which passes the CRC after a brown-out of the sensor. The
+// box never gets that hot, so not even a first sample of 85.0 is real.
+template <typename T, int16_t V>
+struct drop_value {
+	uint16_t rejected;
+
+	bool operator()(T &x)
+	{
+		if (x.raw == V) {
+			rejected++;
+			return false;
+		}
+		return true;
+	}
+};
+
+// Median of the last 3 samples, removes single sample spikes.
+// Replacing a sample by more than W counts as rejected.
+template <typename T, int16_t W>
+struct median3 {
+	T h[2];
+	bool valid;
+	uint16_t rejected;
+
+	bool operator()(T &x)
+	{
+		if (!valid) {
+			h[0] = h[1] = x;
+			valid = true;
+		}
+		T a = h[0], b = h[1];
+		h[1] = h[0];
+		h[0] = x;
+
+		T m = (x < a) ?
+			((a < b) ? a : (x < b) ? b : x) :
+			((x < b) ? x : (a < b) ? b : a);
+
+		if ((m - x).abs().raw > W)
+			rejected++;
+		x = m;
+		return true;
+	}
+};
+
+// Limits the change between two samples to R (raw)
+template <typename T, int16_t R>
+struct rate_limit {
+	T last;
+	bool valid;
+	uint16_t rejected;
+
+	bool operator()(T &x)
+	{
+		if (valid) {
+			if (x.raw > last.raw + R) {
+				x = T::from_raw(last.raw + R);
+				rejected++;
+			} else if (x.raw < last.raw - R) {
+				x = T::from_raw(last.raw - R);
+				rejected++;
+			}
+		}
+		last = x;
+		valid = true;
+		return true;
+	}
+};
+
+// Average of the last N samples, with a running sum
+template <typename T, uint8_t N>
+struct moving_avg {
+	T buf[N];
+	fixed<int32_t, T::frac> sum;
+	uint8_t pos;
+	bool valid;
+	uint16_t rejected;  // always 0
+
+	bool operator()(T &x)
+	{
+		if (!valid) {
+			// start out settled
+			for (uint8_t i=0; i<N; i++)
+				buf[i] = x;
+			sum = x.template as<int32_t>() * N;
+			valid = true;
+		}
+		sum += x.template as<int32_t>() - buf[pos].template as<int32_t>();
+		buf[pos] = x;
+		if (++pos >= N)
+			pos = 0;
+		x = (sum / N).template as<typename T::raw_t>();
+		return true;
+	}
+};
+
+// First order low pass, y += (x - y) / 2^K, time constant ~2^K samples.
+// Not part of temp_filter, append it for a smoother but slower reading.
+template <typename T, uint8_t K>
+struct iir {
+	int32_t acc;  // y with K more fractional bits
+	bool valid;
+	uint16_t rejected;  // always 0
+
+	bool operator()(T &x)
+	{
+		if (!valid) {
+			acc = (int32_t)x.raw * (1 << K);
+			valid = true;
+		}
+		acc += x.raw - (acc >> K);
+		x = T::from_raw(acc >> K);
+		return true;
+	}
+};
+
+template <typename... S>
+struct pipeline;
+
+template <>
+struct pipeline<> {
+	static const uint8_t n_stages = 0;
+
+	template <typename T>
+	bool operator()(T &x) { return true; }
+
+	void counters(uint16_t *c) const {}
+};
+
+template <typename S, typename... R>
+struct pipeline<S, R...> {
+	static const uint8_t n_stages = 1 + sizeof...(R);
+
+	S stage;
+	pipeline<R...> rest;
+
+	template <typename T>
+	bool operator()(T &x)
+	{
+		return stage(x) && rest(x);
+	}
+
+	// rejected samples of each stage, n_stages entries
+	void counters(uint16_t *c) const
+	{
+		*c = stage.rejected;
+		rest.counters(c + 1);
+	}
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef FIXED_H
+#define FIXED_H
+#include <stdint.h>
+
+// Fixed point number: signed storage type T with F fractional bits.
+// Everything is constexpr and inline, an expression compiles to the same
+// shifts, adds and multiplies as the hand written integer code would.
+// Formats never mix silently: converting takes an explicit to<>() / as<>().
+template <typename T, uint8_t F>
+struct fixed {
+	T raw;
+
+	typedef T raw_t;
+	static constexpr uint8_t frac = F;
+
+	// from the integer representation
+	static constexpr fixed from_raw(T r)
+	{
+		return fixed{r};
+	}
+
+	// from a floating point constant, rounded half up like to<>(). Same as
+	// FP() for positive values, FP() truncates the negative ones
+	static constexpr fixed from(double v)
+	{
+		return fixed{floor_raw(v * ((int32_t)1 << F) + 0.5)};
+	}
+
+	static constexpr T floor_raw(double v)
+	{
+		return (T)v - ((double)(T)v > v ? 1 : 0);
+	}
+
+	static constexpr T max_raw()
+	{
+		return (T)(((uint32_t)1 << (sizeof(T) * 8 - 1)) - 1);
+	}
+
+	static constexpr T min_raw()
+	{
+		return -max_raw() - 1;
+	}
+
+	// a 16 bit sum or difference, limited to the range of T
+	static constexpr T sat(int32_t v)
+	{
+		return v > max_raw() ? max_raw() : v < min_raw() ? min_raw() : (T)v;
+	}
+
+	// to G fractional bits, rounded (half up) when bits are dropped. More
+	// bits multiply, a left shift of a negative raw value is undefined
+	template <uint8_t G>
+	constexpr fixed<T, G> to() const
+	{
+		return fixed<T, G>{(T)(G >= F ?
+			raw * ((T)1 << (G >= F ? G - F : 0)) :
+			(raw + ((T)1 << (F > G ? F - G - 1 : 0))) >> (F > G ? F - G : 0))};
+	}
+
+	// to G < F fractional bits, truncated towards zero like an integer
+	// division
+	template <uint8_t G>
+	constexpr fixed<T, G> trunc() const
+	{
+		return fixed<T, G>{(T)(raw / ((T)1 << (F - G)))};
+	}
+
+	// to another storage type, same format
+	template <typename U>
+	constexpr fixed<U, F> as() const
+	{
+		return fixed<U, F>{(U)raw};
+	}
+
+	// 16 bit formats saturate instead of wrapping around, a temperature
+	// must not turn into its opposite. 32 bit ones are sized not to overflow
+	constexpr fixed operator+(fixed b) const
+	{
+		return fixed{sizeof(T) < 4 ? sat((int32_t)raw + b.raw) : (T)(raw + b.raw)};
+	}
+	constexpr fixed operator-(fixed b) const
+	{
+		return fixed{sizeof(T) < 4 ? sat((int32_t)raw - b.raw) : (T)(raw - b.raw)};
+	}
+	constexpr fixed operator-() const
+	{
+		return fixed{sizeof(T) < 4 ? sat(-(int32_t)raw) : (T)-raw};
+	}
+	// by an integer, division truncates like the integer one
+	constexpr fixed operator*(T k) const { return fixed{(T)(raw * k)}; }
+	constexpr fixed operator/(T k) const { return fixed{(T)(raw / k)}; }
+
+	fixed &operator+=(fixed b) { return *this = *this + b; }
+	fixed &operator-=(fixed b) { return *this = *this - b; }
+
+	constexpr bool operator<(fixed b) const { return raw < b.raw; }
+	constexpr bool operator>(fixed b) const { return raw > b.raw; }
+	constexpr bool operator<=(fixed b) const { return raw <= b.raw; }
+	constexpr bool operator>=(fixed b) const { return raw >= b.raw; }
+	constexpr bool operator==(fixed b) const { return raw == b.raw; }
+	constexpr bool operator!=(fixed b) const { return raw != b.raw; }
+
+	// product in the format of *this: (a * b + 1/2) >> G, an integer
+	// factor (G = 0) needs no rounding
+	template <typename U, uint8_t G>
+	constexpr fixed mul(fixed<U, G> b) const
+	{
+		return fixed{(T)((raw * b.raw + (G > 0 ? (T)1 << (G > 0 ? G - 1 : 0) : 0)) >> G)};
+	}
+
+	constexpr fixed abs() const
+	{
+		return raw < 0 ? fixed{(T)-raw} : *this;
+	}
+
+	// limited to [lo, hi]
+	constexpr fixed clamp(fixed lo, fixed hi) const
+	{
+		return raw < lo.raw ? lo : raw > hi.raw ? hi : *this;
+	}
+};
+
+#endif
@@ -2,11 +2,17 @@
 
 #include "gfx.h"
 #include "pid.h"
+#include "ee_store.h"
+#include "autotune.h"
+#include "hist.h"
+#include "rls.h"
 #include "main.h"
 #include "print.h"
 #include "temp_sensor.h"
 #include "glcdfont.cpp"
 #include "ssd1306.h"
+#include "uart_log.h"
+#include "prof.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -28,14 +34,45 @@ uint8_t textsize = 1;   ///< Desired magnification of text to print()
 */
 /**************************************************************************/
 static void drawChar(int16_t x, int16_t y, unsigned char c, uint8_t size) {
+	// doubles each bit: 4 font rows -> 8 display rows
+	static const uint8_t dbl_nibble[16] PROGMEM = {
+		0x00, 0x03, 0x0C, 0x0F, 0x30, 0x33, 0x3C, 0x3F,
+		0xC0, 0xC3, 0xCC, 0xCF, 0xF0, 0xF3, 0xFC, 0xFF
+	};
+
+	// every font pixel is a size x size block, written as whole columns
 	for (int8_t i = 0; i < 5; i++) { // Char bitmap = 5 columns
 		uint8_t line = pgm_read_byte(&font[c * 5 + i]);
+		int16_t xi = x + i * size;
+
+		// font columns are 8 pixel bytes like the framebuffer
+		if (size == 1) {
+			orColumn(xi, y, line);
+			continue;
+		}
+
+		if (size == 2) {
+			uint8_t top = pgm_read_byte(&dbl_nibble[line & 0x0F]);
+			uint8_t bot = pgm_read_byte(&dbl_nibble[line >> 4]);
+			for (int8_t k = 0; k < 2; k++) {
+				orColumn(xi + k, y, top);
+				orColumn(xi + k, y + 8, bot);
+			}
+			continue;
+		}
+
+		// each font row repeated size times, 8 display rows per byte
+		uint8_t bits = 0, n = 0;
+		int16_t yo = y;
 		for (int8_t j = 0; j < 8; j++, line >>= 1) {
-			if (line & 1) {
-				if (size == 1)
-					setPixel(x + i, y + j, 1);
-				else
-					writeFillRect(x + i * size, y + j * size, size, size, 1);
+			for (uint8_t r = 0; r < size; r++) {
+				bits |= (line & 1) << n;
+				if (++n < 8)
+					continue;
+				for (uint8_t k = 0; k < size; k++)
+					orColumn(xi + k, yo, bits);
+				bits = n = 0;
+				yo += 8;
 			}
 		}
 	}
@@ -95,7 +132,7 @@ void _putchar(char c) {
 	if (print_mux & PRINT_OLED)
 		write(c);
 	if (print_mux & PRINT_UART)
-		Serial.write(c);
+		log_putc(c);
 }
 
 
@@ -112,100 +149,484 @@ void _putchar(char c) {
 // }
 
 
-void gui(unsigned long ts_now)
+// --------------------------------------------------------------
+//  Retained GUI elements
+// --------------------------------------------------------------
+// Each widget caches the value it was last rendered with. It is only
+// erased and redrawn when that value changes, so the framebuffer (and
+// with it the dirty region sent to the display) only changes where needed.
+// The table is the draw list which is replayed once per page in
+// SSD_PAGE_MODE.
+struct widget {
+	uint8_t x, y, w, h;  // bounding box, cleared before redrawing
+	uint8_t size;  // text size
+	int32_t (*get)();  // value to display, HIDDEN if not shown
+	void (*draw)(int32_t val);  // called with cursor at x, y
+};
+
+// value of a widget which is not shown
+#define HIDDEN (-0x7FFFFFFFL - 1)
+
+// Fixed point value as it appears on the display with 1 digit
+static int32_t disp_val(int32_t v)
 {
-	print_mux = PRINT_OLED;
-	fill(0);
-
-	// ----------------------
-	//  Top row (yellow)
-	// ----------------------
-	if (heater_enabled) {
-		// bar-graph on the top left
-		hLine(0, 1, DISPLAY_WIDTH / 2, true);
-		hLine(0, 13, DISPLAY_WIDTH / 2, true);
-		int16_t p = (target_heater_power + FP_ROUND) >> (FP_FRAC + 2);
-		if (p > 0)
-			fillRect(0, p, 3, 11, true);
-	} else {
+	int32_t a = ((v < 0 ? -v : v) * 10) >> FP_FRAC;
+	return v < 0 ? ~a : a;
+}
+
+static bool dual()
+{
+	return n_sensors >= 2;
+}
+
+// ----------------------
+//  Top row (yellow)
+// ----------------------
+// bar-graph on the top left
+static int32_t get_bar()
+{
+	if (!heater_enabled)
+		return -1;
+	if (autotune_active())
+		return -2;
+	// [PWM units / 4]
+	return target_heater_power.to<0>().raw >> 2;
+}
+
+static void draw_bar(int32_t p)
+{
+	if (p < 0) {
 		set_cursor(1, 1);
-		print_str("disabled");
+		print_str_P(p == -1 ? PSTR("disabled") : PSTR("tuning"));
+		return;
+	}
+	hLine(0, 1, DISPLAY_WIDTH / 2, true);
+	hLine(0, 13, DISPLAY_WIDTH / 2, true);
+	if (p > 0)
+		fillRect(0, p, 3, 11, true);
+}
+
+// process run time on the top right. For the last CLOCK_MODEL_S of every
+// 10 s, one estimate of the identified box model takes its place, in turn
+// gain, time constant and ambient temperature (see rls.h)
+#define CLOCK_MODEL_S 2
+
+static int32_t get_clock()
+{
+	int32_t t = ms_since_start / 1000;
+	if (rls_valid() && t % 10 >= 10 - CLOCK_MODEL_S)
+		return ~(t / 10 % 3);
+	return t;
+}
+
+static void draw_model(uint8_t item)
+{
+	int32_t gain, tau, ambient;
+	rls_model(&gain, &tau, &ambient);
+
+	if (item == 0) {
+		print_str_P(PSTR("K "));
+		print_dec_fix(gain, FP_FRAC, 1);
+	} else if (item == 1) {
+		print_str_P(PSTR("tau "));
+		print_dec(tau / 60);
+		print_str_P(PSTR("m"));
+	} else {
+		print_str_P(PSTR("amb "));
+		print_dec_fix(ambient, FP_FRAC, 1);
 	}
+}
 
-	// process run time on the top right
-	set_cursor(DISPLAY_WIDTH / 2 + 16, 2);
-	set_size(1);
+static void draw_clock(int32_t val)
+{
+	if (val < 0) {
+		draw_model(~val);
+		return;
+	}
 
-	uint32_t t_process_secs = ms_since_start / 1000;
+	int32_t t_process_secs = val;
 	uint16_t t_process_mins = t_process_secs / 60;
 
 	print_dec(t_process_mins / 60);
-	print_str(":");
+	print_str_P(PSTR(":"));
 	print_udec_dp(t_process_mins % 60, 2, 0);
-	print_str(":");
+	print_str_P(PSTR(":"));
 	print_udec_dp(t_process_secs % 60, 2, 0);
+}
 
-	// ----------------------
-	//  temperature reading
-	// ----------------------
-	set_size(1);
-	set_cursor(0, 17);
-	print_str("air");
+// ----------------------
+//  temperature reading
+// ----------------------
+static int32_t get_always()
+{
+	return 1;
+}
 
-	if (n_sensors >= 2) {
-		set_cursor(DISPLAY_WIDTH / 2, 17);
-		print_str("probe");
-	}
+static int32_t get_dual()
+{
+	return dual() ? 1 : HIDDEN;
+}
+
+static void draw_l_air(int32_t val)
+{
+	print_str_P(PSTR("air"));
+}
+
+static void draw_l_probe(int32_t val)
+{
+	print_str_P(PSTR("probe"));
+}
 
-	set_size(2);
-	set_cursor(0, 31);
+static int32_t get_air()
+{
+	if (one_wire_error > 0)
+		return HIDDEN + 1 + one_wire_error;
+	return disp_val(measured_air_temperature.raw);
+}
+
+static void draw_air(int32_t val)
+{
 	if (one_wire_error > 0) {
-		print_str("E");
+		print_str_P(PSTR("E"));
 		print_udec(one_wire_error);
 	} else {
-		print_dec_fix(measured_air_temperature, FP_FRAC, 1);
-		if (n_sensors >= 2) {
-			set_cursor(DISPLAY_WIDTH / 2, 31);
-			print_dec_fix(measured_probe_temperature, FP_FRAC, 1);
+		print_fix(measured_air_temperature, 1);
+	}
+}
+
+static int32_t get_probe()
+{
+	if (!dual() || one_wire_error > 0)
+		return HIDDEN;
+	return disp_val(measured_probe_temperature.raw);
+}
+
+static void draw_probe(int32_t val)
+{
+	print_fix(measured_probe_temperature, 1);
+}
+
+// ----------------------
+//  set-points
+// ----------------------
+static int32_t get_set_air()
+{
+	return disp_val(target_air_temperature.raw);
+}
+
+static void draw_set_air(int32_t val)
+{
+	print_fix(target_air_temperature, 1);
+	print_str_P(PSTR(" C"));
+}
+
+static int32_t get_set_probe()
+{
+	return dual() ? disp_val(target_probe_temperature.raw) : HIDDEN;
+}
+
+static void draw_set_probe(int32_t val)
+{
+	print_fix(target_probe_temperature, 1);
+	print_str_P(PSTR(" C"));
+}
+
+#define HALF_W (DISPLAY_WIDTH / 2)
+
+static const struct widget widgets[] PROGMEM = {
+	// x, y, w, h, text size, get, draw
+	{0,      0,  HALF_W, 14, 1, get_bar, draw_bar},
+	{HALF_W + 16, 2, HALF_W - 16, 8, 1, get_clock, draw_clock},
+	{0,      17, HALF_W, 8,  1, get_always, draw_l_air},
+	{HALF_W, 17, HALF_W, 8,  1, get_dual, draw_l_probe},
+	{0,      31, HALF_W, 16, 2, get_air, draw_air},
+	{HALF_W, 31, HALF_W, 16, 2, get_probe, draw_probe},
+	{0,      53, HALF_W, 8,  1, get_set_air, draw_set_air},
+	{HALF_W, 53, HALF_W, 8,  1, get_set_probe, draw_set_probe},
+};
+
+#define N_WIDGETS (sizeof(widgets) / sizeof(widgets[0]))
+
+// ----------------------
+//  trend chart screen
+// ----------------------
+#define CHART_Y0 16  // below the yellow rows
+#define CHART_H (DISPLAY_HEIGHT - CHART_Y0)
+
+static int32_t get_chart()
+{
+	return hist_seq();
+}
+
+static int16_t chart_y(int16_t t, int16_t lo, int16_t hi)
+{
+	return DISPLAY_HEIGHT - 1 - (int32_t)(t - lo) * (CHART_H - 1) / (hi - lo);
+}
+
+static void print_hist_temp(int16_t t)
+{
+	print_dec_fix((int32_t)t << (FP_FRAC - HIST_T_BITS), FP_FRAC, 1);
+}
+
+// Air and probe temperature as lines, heater power as bars at the bottom.
+// The Y axis is scaled to the range of the temperatures, at least 2 degC
+static void draw_chart(int32_t val)
+{
+	struct hist_iter it;
+	uint16_t n = hist_n();
+
+	if (n < 2) {
+		print_str_P(PSTR("no history yet"));
+		return;
+	}
+
+	int16_t lo = 0x7FFF, hi = -0x7FFF;
+	hist_first(&it);
+	do {
+		if (it.s.air < lo) lo = it.s.air;
+		if (it.s.air > hi) hi = it.s.air;
+		if (dual()) {
+			if (it.s.probe < lo) lo = it.s.probe;
+			if (it.s.probe > hi) hi = it.s.probe;
 		}
+	} while (hist_next(&it));
+
+	if (hi - lo < 2 * HIST_T_SCALE) {
+		lo = (lo + hi) / 2 - HIST_T_SCALE;
+		hi = lo + 2 * HIST_T_SCALE;
 	}
 
-	// ----------------------
-	//  set-points
-	// ----------------------
-	set_size(1);
-	set_cursor(0, 53);
-	print_dec_fix(target_air_temperature, FP_FRAC, 1);
-	print_str(" C");
+	// range and time span in the top row
+	print_hist_temp(lo);
+	print_str_P(PSTR(" - "));
+	print_hist_temp(hi);
+	print_str_P(PSTR(" C "));
+	// older samples are gone, the buffer is shorter than the run
+	if (hist_dropped())
+		print_str_P(PSTR("<"));
+	print_udec((uint32_t)(n - 1) * HIST_PERIOD / 3600);
+	print_str_P(PSTR(" h"));
+
+	int16_t x0 = 0, air0 = 0, probe0 = 0;
+	hist_first(&it);
+	do {
+		int16_t x = (int32_t)it.i * (DISPLAY_WIDTH - 1) / (n - 1);
+		int16_t air = chart_y(it.s.air, lo, hi);
+		int16_t probe = chart_y(it.s.probe, lo, hi);
+
+		if (it.s.power > 0)
+			vLine(x, DISPLAY_HEIGHT - it.s.power, it.s.power, true);
+		if (it.i > 0) {
+			line(x0, air0, x, air);
+			if (dual())
+				line(x0, probe0, x, probe);
+		}
+		x0 = x;
+		air0 = air;
+		probe0 = probe;
+	} while (hist_next(&it));
+}
+
+static const struct widget chart_widgets[] PROGMEM = {
+	{0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, 1, get_chart, draw_chart},
+};
+
+// ----------------------
+//  live strip chart screen
+// ----------------------
+// Air temperature around the set-point, one column per LIVE_PERIOD. The
+// display scrolls the chart, only the new column goes over the bus.
+#define LIVE_PERIOD 10  // [s]
+#define LIVE_P0 2  // first page, below the yellow rows
+#define LIVE_H (DISPLAY_HEIGHT - LIVE_P0 * 8)
+#define LIVE_RANGE 2  // +- [degC] around the set-point
+
+static unsigned long ts_live;
 
-	if (n_sensors >= 2) {
-		set_cursor(DISPLAY_WIDTH / 2, 53);
-		print_dec_fix(target_probe_temperature, FP_FRAC, 1);
-		print_str(" C");
+static int32_t get_live()
+{
+	return disp_val(target_air_temperature.raw);
+}
+
+static void draw_live(int32_t val)
+{
+	print_str_P(PSTR("air "));
+	print_fix(target_air_temperature, 1);
+	print_str_P(PSTR(" C +-"));
+	print_udec(LIVE_RANGE);
+}
+
+static void live_column()
+{
+	static uint8_t n = 0;
+	uint8_t bits[LIVE_H / 8] = {0};
+
+	// dotted set-point in the middle
+	if ((++n & 3) == 0)
+		bits[LIVE_H / 16] |= 1 << ((LIVE_H / 2) & 7);
+
+	int32_t d = (measured_air_temperature - target_air_temperature).raw;
+	int32_t y = LIVE_H / 2 - d * (LIVE_H / 2) / (LIVE_RANGE << FP_FRAC);
+	if (y < 0)
+		y = 0;
+	if (y > LIVE_H - 1)
+		y = LIVE_H - 1;
+	bits[y >> 3] |= 1 << (y & 7);
+
+	ssd_scroll_step();
+	ssd_put_column(DISPLAY_WIDTH - 1, bits);
+}
+
+static const struct widget live_widgets[] PROGMEM = {
+	{0, 2, DISPLAY_WIDTH, 8, 1, get_live, draw_live},
+};
+
+// widget tables, a short push of MID switches between them
+static const struct {
+	const struct widget *w;
+	uint8_t n;
+} screens[] = {
+	{widgets, N_WIDGETS},
+	{chart_widgets, sizeof(chart_widgets) / sizeof(chart_widgets[0])},
+	{live_widgets, sizeof(live_widgets) / sizeof(live_widgets[0])},
+};
+
+#define N_SCREENS (sizeof(screens) / sizeof(screens[0]))
+
+static uint8_t screen = 0, shown_screen = 0;
+
+void gui_next_screen()
+{
+	screen = (screen + 1) % N_SCREENS;
+}
+
+void gui_redraw()
+{
+	shown_screen = 0xFF;
+}
+
+static struct {
+	int32_t val;  // last rendered value
+	bool valid;
+	bool changed;
+} w_state[N_WIDGETS];  // sized for the largest screen
+
+void gui(unsigned long ts_now)
+{
+	PROF_SCOPE(PROF_GUI);
+	struct widget w;
+	uint8_t x0 = 0xFF, x1 = 0, y0 = 0xFF, y1 = 0;
+
+	// a new screen starts from a blank display
+	bool switched = screen != shown_screen;
+	if (switched) {
+		for (uint8_t i=0; i<N_WIDGETS; i++)
+			w_state[i].valid = false;
+		shown_screen = screen;
+		x0 = y0 = 0;
+		x1 = DISPLAY_WIDTH - 1;
+		y1 = DISPLAY_HEIGHT - 1;
+	}
+	const struct widget *ws = screens[screen].w;
+	uint8_t n_ws = screens[screen].n;
+
+	// the strip chart is not part of the widgets, it starts out blank
+	if (ws == live_widgets && !switched &&
+	    ts_now - ts_live >= LIVE_PERIOD * 1000UL) {
+		ts_live = ts_now;
+		live_column();
+	}
+
+	// find the widgets which changed and the region they cover
+	for (uint8_t i=0; i<n_ws; i++) {
+		memcpy_P(&w, &ws[i], sizeof(w));
+		int32_t val = w.get();
+
+		w_state[i].changed = !w_state[i].valid || w_state[i].val != val;
+		if (!w_state[i].changed)
+			continue;
+
+		w_state[i].valid = true;
+		w_state[i].val = val;
+
+		if (w.x < x0) x0 = w.x;
+		if (w.x + w.w - 1 > x1) x1 = w.x + w.w - 1;
+		if (w.y < y0) y0 = w.y;
+		if (w.y + w.h - 1 > y1) y1 = w.y + w.h - 1;
+	}
+
+	// nothing to do
+	if (y0 > y1)
+		return;
+
+	print_mux = PRINT_OLED;
+
+	ssd_first_page(y0 >> 3, y1 >> 3, x0, x1);
+	do {
+#ifndef SSD_PAGE_MODE
+		if (switched)
+			fill(false);
+#endif
+		for (uint8_t i=0; i<n_ws; i++) {
+			memcpy_P(&w, &ws[i], sizeof(w));
+#ifdef SSD_PAGE_MODE
+			// page starts out empty, draw everything on it
+			if (!ssd_in_page(w.y, w.y + w.h - 1))
+				continue;
+#else
+			// the rest is still in the framebuffer
+			if (!w_state[i].changed)
+				continue;
+			fillRect(w.x, w.x + w.w - 1, w.y, w.y + w.h - 1, false);
+#endif
+			if (w_state[i].val == HIDDEN)
+				continue;
+
+			set_cursor(w.x, w.y);
+			set_size(w.size);
+			w.draw(w_state[i].val);
+		}
+	} while (ssd_next_page());
+
+	if (switched && ws == live_widgets) {
+		ssd_scroll_setup(LIVE_P0, DISPLAY_HEIGHT / 8 - 1, 0, DISPLAY_WIDTH - 1);
+		ts_live = ts_now;
 	}
 
-	ssd_send();
 	print_mux = PRINT_UART;
 }
 
 void buttons(unsigned long ts_now)
 {
 	static uint8_t idle_cycles=0xFF, pushed_cycles=0, n_incr=0;
-	static uint16_t mid_cycles = 0;
-	static unsigned long ts = 0;
+	static uint16_t mid_cycles = 0, tune_cycles = 0;
 
-	if (ts_now - ts <= 1)
+	// MID + UP held for 3 s starts / aborts the air loop auto-tuning
+	if (digitalRead(PIN_MID) == 0 && digitalRead(PIN_UP) == 0) {
+		mid_cycles = 0;
+		if (++tune_cycles == 1500) {
+			if (autotune_active())
+				autotune_abort();
+			else if (heater_enabled)
+				autotune_start();
+		}
 		return;
-	ts = ts_now;
+	}
+	tune_cycles = 0;
 
 	if (digitalRead(PIN_MID) == 0) {
-		mid_cycles++;
-		if (mid_cycles >= 500) {
-			print_str("reseting process timer\n");
-			mid_cycles = 0;
+		if (mid_cycles < 0xFFFF)
+			mid_cycles++;
+		if (mid_cycles == 500) {
+			print_str_P(PSTR("reseting process timer\n"));
 			ms_since_start = 0;
 		}
 	} else {
+		// a short push switches the screen
+		if (mid_cycles >= 10 && mid_cycles < 500) {
+			gui_next_screen();
+			gui(ts_now);
+		}
 		mid_cycles = 0;
 	}
 
@@ -219,9 +640,9 @@ void buttons(unsigned long ts_now)
 		n_incr = 0;
 
 		if (idle_cycles == 0xFE) {
-			store_ee(target_probe_temperature, SL_T_SET);
+			store_ee(target_probe_temperature.raw, SL_T_SET);
 			if (!heater_enabled) {
-				print_str("Enabling heater\n");
+				print_str_P(PSTR("Enabling heater\n"));
 				heater_enabled = true;
 			}
 		}
@@ -234,15 +655,18 @@ void buttons(unsigned long ts_now)
 
 	if (pushed_cycles == 5) {
 		if (n_incr > 10) {
-			target_probe_temperature += FP(1.0) * sign;
+			target_probe_temperature += fp16::from(1.0) * sign;
 		} else {
-			target_probe_temperature += FP(0.1) * sign;
+			target_probe_temperature += fp16::from(0.1) * sign;
 			n_incr++;
 		}
-		target_probe_temperature = limit(target_probe_temperature, AIR_MIN_LIMIT, AIR_MAX_LIMIT);
+		target_probe_temperature = target_probe_temperature.clamp(
+			fp16::from_raw(AIR_MIN_LIMIT), fp16::from_raw(AIR_MAX_LIMIT));
 		if (n_sensors == 1)
 			target_air_temperature = target_probe_temperature;
 		idle_cycles = 0;
+		// show the set-point
+		screen = 0;
 		gui(ts_now);
 	}
 
@@ -11,6 +11,10 @@ void pd(const char *format, ...);
 // void drawChar(int16_t x, int16_t y, unsigned char c, uint8_t size);
 
 void gui(unsigned long ts_now);
+// Switch between the readings, the trend chart and the live chart
+void gui_next_screen();
+// Draw the whole screen again with the next gui(), like after a switch
+void gui_redraw();
 void buttons(unsigned long ts_now);
 
 extern uint8_t print_mux;
@@ -0,0 +1,123 @@
+#include <stdint.h>
+#include <Arduino.h>
+#include "hatch.h"
+#include "pid.h"
+#include "ee_store.h"
+#include "print.h"
+#include "main.h"
+
+enum HATCH_STATES {
+	HATCH_IDLE,
+	HATCH_SETTLE,  // direction switched, wait before enabling the motor
+	HATCH_MOVING,
+	HATCH_STOPPED  // motor disabled, wait for it to halt, then release the direction
+};
+
+static uint8_t state = HATCH_IDLE;
+static int16_t current_pos = 0;
+static int16_t target_pos = 0;
+static int16_t stored_pos = 0;
+static bool closing = false;
+static unsigned long ts_state = 0;  // in HATCH_IDLE: since the last stop
+
+void hatch_init()
+{
+	int32_t tmp = 0;
+	if (load_ee(&tmp, SL_HATCH_POS))
+		current_pos = limit(tmp, 0, MAX_HATCH);
+	target_pos = current_pos;
+	stored_pos = current_pos;
+}
+
+void hatch_move(int16_t amount)
+{
+	target_pos = limit(target_pos + amount, 0, MAX_HATCH);
+}
+
+bool hatch_busy()
+{
+	return state != HATCH_IDLE;
+}
+
+int16_t hatch_pos()
+{
+	return current_pos;
+}
+
+static void store_pos()
+{
+	store_ee(current_pos, SL_HATCH_POS);
+	stored_pos = current_pos;
+}
+
+static void stop(unsigned long ts_now)
+{
+	// the direction is released once the motor stands still
+	digitalWrite(PIN_MOTOR_ENABLE, LOW);
+	ts_state = ts_now;
+	state = HATCH_STOPPED;
+
+	print_str_P(PSTR("Hatch @ ")); print_dec(current_pos); print_str_P(PSTR("\n"));
+	// small moves of the controller wait for HATCH_STORE_IDLE
+	if (abs(current_pos - stored_pos) >= HATCH_STORE_STEPS)
+		store_pos();
+}
+
+void hatch_tick(unsigned long ts_now)
+{
+	switch (state) {
+	case HATCH_IDLE:
+		if (target_pos == current_pos) {
+			if (current_pos != stored_pos && ts_now - ts_state >= HATCH_STORE_IDLE)
+				store_pos();
+			return;
+		}
+
+		closing = target_pos < current_pos;
+		ts_state = ts_now;
+		if (closing) {
+			digitalWrite(PIN_MOTOR_DIRECTION, HIGH);
+			state = HATCH_SETTLE;
+		} else {
+			digitalWrite(PIN_MOTOR_ENABLE, HIGH);
+			state = HATCH_MOVING;
+		}
+		break;
+
+	case HATCH_SETTLE:
+		if (ts_now - ts_state < HATCH_SETTLE_TIME)
+			return;
+
+		ts_state = ts_now;
+		digitalWrite(PIN_MOTOR_ENABLE, HIGH);
+		state = HATCH_MOVING;
+		break;
+
+	case HATCH_MOVING:
+		if (ts_now - ts_state < HATCH_STEP_TIME)
+			return;
+
+		// drift-free, the motor keeps running between steps
+		ts_state += HATCH_STEP_TIME;
+		current_pos += closing ? -1 : 1;
+
+		// stop at the target or if it moved to the other side
+		if (current_pos == target_pos || (target_pos < current_pos) != closing)
+			stop(ts_now);
+		break;
+
+	case HATCH_STOPPED:
+		if (ts_now - ts_state < HATCH_SETTLE_TIME)
+			return;
+
+		// settles like before closing, opening starts right away
+		if (closing) {
+			digitalWrite(PIN_MOTOR_DIRECTION, LOW);
+			closing = false;
+			ts_state = ts_now;
+			return;
+		}
+		state = HATCH_IDLE;
+		break;
+	}
+}
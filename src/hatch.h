@@ -0,0 +1,37 @@
+#ifndef HATCH_H
+#define HATCH_H
+#include <stdint.h>
+
+// Hatch position limit [steps]
+#define MAX_HATCH 55
+
+// Motor run time per step [ms]
+#define HATCH_STEP_TIME 250
+
+// Dead time of the motor [ms]: after switching the direction, before the
+// motor is enabled, and after disabling it, before the direction is
+// released. A reversal waits for both.
+#define HATCH_SETTLE_TIME 100
+
+// The position is stored in EEPROM once it is this far from the stored
+// one [steps], otherwise after the hatch was idle for HATCH_STORE_IDLE
+#define HATCH_STORE_STEPS 4
+#define HATCH_STORE_IDLE 60000UL  // [ms]
+
+// Restores the last position from EEPROM
+void hatch_init();
+
+// Move the hatch by `amount` steps relative to the current target,
+// returns immediately
+void hatch_move(int16_t amount);
+
+// Call this as often as possible, drives the motor
+void hatch_tick(unsigned long ts_now);
+
+// true while the motor is running or in its dead time
+bool hatch_busy();
+
+// current position in [steps], 0 = closed
+int16_t hatch_pos();
+
+#endif
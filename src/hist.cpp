@@ -0,0 +1,204 @@
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include "hist.h"
+#include "main.h"
+#include "uart_log.h"
+#include "print.h"
+
+#define N_CH 3
+#define N_NIBS (HIST_BYTES * 2)
+
+// control cycles per sample
+#define N_AVG_CYCLES (HIST_PERIOD * 1000L / CYCLE_TIME)
+
+// longest record: 16 bit zigzag values, 3 bits per nibble
+#define MAX_REC (N_CH * 6)
+
+static uint8_t buf[HIST_BYTES];
+static uint16_t head = 0, tail = 0;  // [nibbles]
+static uint16_t used = 0;  // [nibbles]
+
+// oldest and newest sample
+static int16_t base[N_CH], last[N_CH];
+static uint16_t n_samples = 0;
+static uint16_t seq = 0;
+static bool dropped = false;
+
+// running sums for the average
+static int32_t sum[N_CH];
+static uint16_t n_sum = 0;
+
+static uint8_t get_nib(uint16_t pos)
+{
+	uint8_t b = buf[pos >> 1];
+	return (pos & 1) ? b >> 4 : b & 0x0F;
+}
+
+static void put_nib(uint16_t pos, uint8_t v)
+{
+	uint8_t *b = &buf[pos >> 1];
+	*b = (pos & 1) ? (*b & 0x0F) | (v << 4) : (*b & 0xF0) | v;
+}
+
+static uint16_t next_pos(uint16_t pos)
+{
+	return (pos + 1 < N_NIBS) ? pos + 1 : 0;
+}
+
+// Decodes one value at *pos
+static int16_t get_val(uint16_t *pos)
+{
+	uint16_t z = 0;
+	uint8_t shift = 0, n;
+
+	do {
+		n = get_nib(*pos);
+		*pos = next_pos(*pos);
+		z |= (uint16_t)(n & 7) << shift;
+		shift += 3;
+	} while (n & 8);
+
+	// zigzag: 0, -1, 1, -2, ...
+	return (z >> 1) ^ -(int16_t)(z & 1);
+}
+
+// Decodes one record at *pos onto v
+static void get_rec(uint16_t *pos, int16_t *v)
+{
+	for (uint8_t c=0; c<N_CH; c++)
+		v[c] += get_val(pos);
+}
+
+static void store(const int16_t *v)
+{
+	if (n_samples == 0) {
+		for (uint8_t c=0; c<N_CH; c++)
+			base[c] = last[c] = v[c];
+		n_samples = 1;
+		seq++;
+		return;
+	}
+
+	uint8_t rec[MAX_REC], len = 0;
+	for (uint8_t c=0; c<N_CH; c++) {
+		int16_t d = v[c] - last[c];
+		uint16_t z = ((uint16_t)d << 1) ^ (uint16_t)(d >> 15);
+		do {
+			rec[len] = z & 7;
+			z >>= 3;
+			if (z)
+				rec[len] |= 8;
+			len++;
+		} while (z);
+		last[c] = v[c];
+	}
+
+	// make room, the second oldest sample becomes the base
+	while (N_NIBS - used < len) {
+		uint16_t pos = tail;
+		get_rec(&pos, base);
+		used -= (pos - tail + N_NIBS) % N_NIBS;
+		tail = pos;
+		n_samples--;
+		dropped = true;
+	}
+
+	for (uint8_t i=0; i<len; i++) {
+		put_nib(head, rec[i]);
+		head = next_pos(head);
+	}
+	used += len;
+	n_samples++;
+	seq++;
+}
+
+void hist_update(fp16 air, fp16 probe, fp16 power)
+{
+	sum[0] += air.raw;
+	sum[1] += probe.raw;
+	sum[2] += power.raw;
+	if (++n_sum < N_AVG_CYCLES)
+		return;
+
+	int16_t v[N_CH];
+	for (uint8_t c=0; c<2; c++) {
+		int16_t avg = sum[c] / n_sum;
+		v[c] = (avg + (1 << (FP_FRAC - HIST_T_BITS - 1))) >> (FP_FRAC - HIST_T_BITS);
+	}
+	v[2] = (sum[2] / n_sum * HIST_P_MAX + POWER_MAX_LIMIT / 2) / POWER_MAX_LIMIT;
+
+	store(v);
+
+	for (uint8_t c=0; c<N_CH; c++)
+		sum[c] = 0;
+	n_sum = 0;
+}
+
+uint16_t hist_n()
+{
+	return n_samples;
+}
+
+uint16_t hist_seq()
+{
+	return seq;
+}
+
+bool hist_dropped()
+{
+	return dropped;
+}
+
+static void set_sample(struct hist_iter *it, const int16_t *v)
+{
+	it->s.air = v[0];
+	it->s.probe = v[1];
+	it->s.power = v[2];
+}
+
+bool hist_first(struct hist_iter *it)
+{
+	it->pos = tail;
+	it->i = 0;
+	set_sample(it, base);
+	return n_samples > 0;
+}
+
+bool hist_next(struct hist_iter *it)
+{
+	if (it->i + 1 >= n_samples)
+		return false;
+
+	int16_t v[N_CH] = {it->s.air, it->s.probe, it->s.power};
+	get_rec(&it->pos, v);
+	set_sample(it, v);
+	it->i++;
+	return true;
+}
+
+static void print_temp(int16_t t)
+{
+	print_str_P(PSTR(","));
+	print_dec_fix((int32_t)t << (FP_FRAC - HIST_T_BITS), FP_FRAC, 2);
+}
+
+void hist_print()
+{
+	struct hist_iter it;
+
+	if (!hist_first(&it))
+		return;
+
+	// too much for the log buffer
+	log_blocking(true);
+	print_str_P(PSTR("min,air,probe,power\n"));
+	do {
+		print_dec(-(int32_t)(n_samples - 1 - it.i) * (HIST_PERIOD / 60));
+		print_temp(it.s.air);
+		print_temp(it.s.probe);
+		print_str_P(PSTR(","));
+		print_dec(it.s.power);
+		print_str_P(PSTR("\n"));
+	} while (hist_next(&it));
+	log_blocking(false);
+}
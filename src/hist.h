@@ -0,0 +1,62 @@
+#ifndef HIST_H
+#define HIST_H
+#include <stdint.h>
+#include "pid.h"
+#include "ssd1306.h"
+
+// Temperature history for the trend chart: air, probe and heater power,
+// averaged over HIST_PERIOD. Samples are stored as deltas to the previous
+// one in a ring buffer of nibbles, zigzag encoded with 3 bits per nibble
+// and the 4th bit set if more nibbles follow. A steady box costs 3 nibbles
+// per sample, the oldest samples are dropped when the buffer is full.
+
+// Seconds per sample
+#define HIST_PERIOD 900
+
+// Bytes of SRAM for the samples, 48 h need ~350 (3 - 4 nibbles / sample)
+#ifdef SSD_PAGE_MODE
+	#define HIST_BYTES 448
+#else
+	// the framebuffer takes most of the SRAM, only ~16 h
+	#define HIST_BYTES 96
+#endif
+
+// Resolution of the stored temperatures, 1 / HIST_T_SCALE degC
+#define HIST_T_BITS 2
+#define HIST_T_SCALE (1 << HIST_T_BITS)
+// Heater power is stored as 0 ... HIST_P_MAX
+#define HIST_P_MAX 15
+
+struct hist_sample {
+	int16_t air, probe;  // [degC * HIST_T_SCALE]
+	int16_t power;
+};
+
+// Walks the history, oldest sample first
+struct hist_iter {
+	struct hist_sample s;
+	uint16_t pos;  // next record [nibbles]
+	uint16_t i;  // index of s
+};
+
+// Call this once per control cycle
+void hist_update(fp16 air, fp16 probe, fp16 power);
+
+// Number of stored samples
+uint16_t hist_n();
+
+// Changes with every stored sample
+uint16_t hist_seq();
+
+// True once the oldest samples were dropped to make room
+bool hist_dropped();
+
+// Returns false if the history is empty
+bool hist_first(struct hist_iter *it);
+// Returns false after the newest sample
+bool hist_next(struct hist_iter *it);
+
+// Print as CSV, one line per sample
+void hist_print();
+
+#endif
@@ -8,6 +8,8 @@
 **************************************************************************/
 #include <inttypes.h>
 #include <compat/twi.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
 #include <i2cmaster.h>
 
@@ -42,6 +44,9 @@ unsigned char i2c_start(unsigned char address)
 {
     uint8_t   twst;
 
+	// let the interrupt driven transactions finish first
+	i2c_wait_idle();
+
 	// send START condition
 	TWCR = (1<<TWINT) | (1<<TWSTA) | (1<<TWEN);
 
@@ -78,6 +83,7 @@ void i2c_start_wait(unsigned char address)
 {
     uint8_t   twst;
 
+	i2c_wait_idle();
 
     while ( 1 )
     {
@@ -200,3 +206,123 @@ unsigned char i2c_readNak(void)
     return TWDR;
 
 }/* i2c_readNak */
+
+
+/*************************************************************************
+ Interrupt driven transaction queue
+
+ Ring buffer of pointers to caller owned descriptors. The TWI interrupt
+ walks through the queue and streams out one byte per interrupt, so the
+ main loop only pays for the ISR (a few us) instead of the full byte time.
+*************************************************************************/
+static struct i2c_xfer * volatile q[I2C_QUEUE_LEN];
+static volatile uint8_t q_head = 0, q_tail = 0;
+static volatile uint8_t q_active = 0;
+static unsigned q_pos;
+
+#define TWCR_NEXT ((1<<TWINT) | (1<<TWEN) | (1<<TWIE))
+
+static void xfer_done(struct i2c_xfer *x, uint8_t status)
+{
+	// always release the bus after an error
+	uint8_t stop = status || !(x->flags & I2C_XF_NOSTOP);
+
+	x->status = status;
+	q_tail = (q_tail + 1) % I2C_QUEUE_LEN;
+	if (x->done)
+		x->done(status);
+
+	if (q_tail != q_head) {
+		// STOP followed by START or a repeated START
+		TWCR = TWCR_NEXT | (1<<TWSTA) | (stop ? (1<<TWSTO) : 0);
+		return;
+	}
+
+	q_active = 0;
+	if (stop)
+		TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO);
+	else
+		TWCR = (1<<TWEN);  // keep holding the bus, TWINT stays set
+}
+
+ISR(TWI_vect)
+{
+	struct i2c_xfer *x = q[q_tail];
+	const uint8_t *p;
+
+	switch (TW_STATUS) {
+	case TW_START:
+	case TW_REP_START:
+		TWDR = x->addr;
+		q_pos = 0;
+		TWCR = TWCR_NEXT;
+		break;
+
+	case TW_MT_SLA_ACK:
+		if (x->flags & I2C_XF_PREFIX) {
+			TWDR = x->prefix;
+			TWCR = TWCR_NEXT;
+			break;
+		}
+		// fall through
+	case TW_MT_DATA_ACK:
+		if (q_pos >= x->len) {
+			xfer_done(x, 0);
+			break;
+		}
+		p = x->buf + q_pos++;
+		TWDR = (x->flags & I2C_XF_PGM) ? pgm_read_byte(p) : *p;
+		TWCR = TWCR_NEXT;
+		break;
+
+	default:
+		// NACK or arbitration lost
+		xfer_done(x, 1);
+	}
+}
+
+
+/*************************************************************************
+ Queue a write transaction
+ Return:  0 queued
+          1 queue is full
+*************************************************************************/
+unsigned char i2c_queue(struct i2c_xfer *x)
+{
+	uint8_t sreg = SREG;
+	cli();
+
+	uint8_t next = (q_head + 1) % I2C_QUEUE_LEN;
+	if (next == q_tail) {
+		SREG = sreg;
+		return 1;
+	}
+	x->status = I2C_XF_BUSY;
+	q[q_head] = x;
+	q_head = next;
+
+	if (!q_active) {
+		// wait for a previous stop condition to go out
+		while (TWCR & (1<<TWSTO));
+		q_active = 1;
+		TWCR = TWCR_NEXT | (1<<TWSTA);
+	}
+
+	SREG = sreg;
+	return 0;
+
+}/* i2c_queue */
+
+
+unsigned char i2c_busy(void)
+{
+	return q_active || (TWCR & (1<<TWSTO));
+
+}/* i2c_busy */
+
+
+void i2c_wait_idle(void)
+{
+	while (i2c_busy());
+
+}/* i2c_wait_idle */
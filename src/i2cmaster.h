@@ -173,6 +173,57 @@ extern unsigned char i2c_read(unsigned char ack);
 #define i2c_read(ack)  (ack) ? i2c_readAck() : i2c_readNak();
 
 
+/**
+ @brief Interrupt driven write transaction, see @ref i2c_queue
+
+ The descriptor and the payload are owned by the caller and must stay valid
+ (and unmodified) until the transaction completed.
+ */
+struct i2c_xfer {
+	unsigned char addr;         /**< address and transfer direction (only I2C_WRITE) */
+	unsigned char flags;        /**< I2C_XF_* bits */
+	unsigned char prefix;       /**< sent before the payload with I2C_XF_PREFIX */
+	const unsigned char *buf;   /**< payload, in SRAM or flash (I2C_XF_PGM) */
+	unsigned len;               /**< payload length in bytes */
+	void (*done)(unsigned char status);  /**< optional, called from the ISR */
+	volatile unsigned char status;       /**< I2C_XF_BUSY, 0 = ok, 1 = failed */
+};
+
+/** payload pointer is in program memory */
+#define I2C_XF_PGM    (1 << 0)
+/** don't release the bus, next queued transaction starts with a repeated start */
+#define I2C_XF_NOSTOP (1 << 1)
+/** send the prefix byte right after the address */
+#define I2C_XF_PREFIX (1 << 2)
+
+/** status of a transaction which is queued or in flight */
+#define I2C_XF_BUSY   0xFF
+
+/** size of the transaction ring buffer, up to I2C_QUEUE_LEN - 1 can be queued */
+#define I2C_QUEUE_LEN 4
+
+/**
+ @brief Queue a write transaction, it is streamed out in the background by the TWI interrupt
+
+ @param    x transaction descriptor, must stay valid until x->status != I2C_XF_BUSY
+ @retval   0 transaction queued
+ @retval   1 queue full
+ */
+extern unsigned char i2c_queue(struct i2c_xfer *x);
+
+/**
+ @brief Returns non-zero while queued transactions are pending
+ */
+extern unsigned char i2c_busy(void);
+
+/**
+ @brief Block until all queued transactions completed and the bus is released
+
+ Called by the blocking API, so it can be freely mixed with @ref i2c_queue
+ */
+extern void i2c_wait_idle(void);
+
+
 
 /**@}*/
 #endif
@@ -0,0 +1,218 @@
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include "kalman.h"
+#include "hatch.h"
+#include "main.h"
+#include "uart_log.h"
+#include "print.h"
+#include "prof.h"
+
+// Fixed point formats
+//   states:                  Q16  [degC]
+//   model, covariance, gain: Q24
+#define Q_X 16
+#define Q_P 24
+
+#define KQ(v) ((int32_t)((v) * (1L << Q_P) + 0.5))
+
+// model step [s]
+#define DT_S (CYCLE_TIME / 1000.0)
+
+// coefficients of the Euler step
+#define A_PA KQ(DT_S * KF_G_PLATE_AIR / KF_C_PLATE)
+#define B_P KQ(DT_S * KF_P_HEATER / KF_C_PLATE)
+#define A_AP KQ(DT_S * KF_G_PLATE_AIR / KF_C_AIR)
+#define A_AT KQ(DT_S * KF_G_AIR_TEMPEH / KF_C_AIR)
+#define A_AMB KQ(DT_S * KF_G_AIR_AMB / KF_C_AIR)
+#define A_HATCH KQ(DT_S * KF_G_HATCH / KF_C_AIR)
+#define A_TA KQ(DT_S * KF_G_AIR_TEMPEH / KF_C_TEMPEH)
+#define ONE ((int32_t)1 << Q_P)
+
+enum { PLATE, AIR, TEMPEH, AMB, N_X };
+
+static int32_t x[N_X];
+static int32_t P[N_X][N_X];
+static const int32_t Q[N_X] = {
+	KQ(KF_Q_PLATE), KQ(KF_Q_AIR), KQ(KF_Q_TEMPEH), KQ(KF_Q_AMB)
+};
+
+static uint16_t n_steps = 0;
+static uint8_t n_off[2];  // readings in a row outside the gate
+static uint16_t n_on[2];  // and inside
+static uint8_t suspect = 0;
+
+static void reset(int32_t t)
+{
+	for (uint8_t i=0; i<N_X; i++) {
+		x[i] = t;
+		for (uint8_t j=0; j<N_X; j++)
+			P[i][j] = (i == j) ? KQ(KF_P0) : 0;
+	}
+	x[AMB] = limit(t, (int32_t)KF_T_AMB_MIN << (Q_X - FP_FRAC),
+		(int32_t)KF_T_AMB_MAX << (Q_X - FP_FRAC));
+	P[AMB][AMB] = KQ(KF_P0_AMB);
+}
+
+// x = F x + B u, P = F P F' + Q
+static void predict(int32_t u)
+{
+	int32_t g_amb = A_AMB + A_HATCH * hatch_pos() / MAX_HATCH;
+	const int32_t F[N_X][N_X] = {
+		{ONE - A_PA, A_PA, 0, 0},
+		{A_AP, ONE - A_AP - g_amb - A_AT, A_AT, g_amb},
+		{0, A_TA, ONE - A_TA, 0},
+		{0, 0, 0, ONE},
+	};
+
+	int64_t xn[N_X];
+	for (uint8_t i=0; i<N_X; i++) {
+		xn[i] = 0;
+		for (uint8_t j=0; j<N_X; j++)
+			xn[i] += (int64_t)F[i][j] * x[j];
+	}
+	xn[PLATE] += (int64_t)B_P * u;
+	for (uint8_t i=0; i<N_X; i++)
+		x[i] = xn[i] >> Q_P;
+
+	int64_t fp[N_X][N_X];
+	for (uint8_t i=0; i<N_X; i++) {
+		for (uint8_t j=0; j<N_X; j++) {
+			fp[i][j] = 0;
+			for (uint8_t k=0; k<N_X; k++)
+				fp[i][j] += (int64_t)F[i][k] * P[k][j];
+			fp[i][j] >>= Q_P;
+		}
+	}
+	for (uint8_t i=0; i<N_X; i++) {
+		for (uint8_t j=i; j<N_X; j++) {
+			int64_t v = 0;
+			for (uint8_t k=0; k<N_X; k++)
+				v += fp[i][k] * F[j][k];
+			v >>= Q_P;
+			if (i == j)
+				v += Q[i];
+			// keep it symmetric
+			P[i][j] = P[j][i] = v;
+		}
+	}
+}
+
+// Measurement z [Q16] of state i, returns false if it is outside the gate
+static bool correct(uint8_t i, int32_t z, bool gate)
+{
+	int32_t e = z - x[i];
+	int64_t s = (int64_t)P[i][i] + KQ(KF_R);
+
+	// e^2 / s > gate^2, e^2 is Q32
+	if (gate && (int64_t)e * e > ((int64_t)KF_GATE * KF_GATE * s) << (2 * Q_X - Q_P))
+		return false;
+
+	// gain P h / s, h selects state i
+	int64_t k[N_X];
+	int32_t p_i[N_X];
+	for (uint8_t j=0; j<N_X; j++) {
+		k[j] = ((int64_t)P[j][i] << Q_P) / s;
+		p_i[j] = P[i][j];
+		x[j] += (k[j] * e) >> Q_P;
+	}
+	for (uint8_t j=0; j<N_X; j++)
+		for (uint8_t l=j; l<N_X; l++)
+			P[j][l] = P[l][j] = P[j][l] - ((k[j] * p_i[l]) >> Q_P);
+	return true;
+}
+
+// With a single sensor there is nothing to cross-check, it is always used
+static void measure(uint8_t sensor, uint8_t i, fp16 t, bool gate)
+{
+	uint8_t bit = sensor ? KF_SUSPECT_PROBE : KF_SUSPECT_AIR;
+
+	if (correct(i, (int32_t)t.raw << (Q_X - FP_FRAC), gate)) {
+		n_off[sensor] = 0;
+		// the flag stays until the sensor agrees for a while
+		if (++n_on[sensor] >= KF_N_AGREE)
+			suspect &= ~bit;
+		return;
+	}
+
+	if (++n_off[sensor] < KF_N_SUSPECT)
+		return;
+	n_off[sensor] = 0;
+	n_on[sensor] = 0;
+
+	if (!(suspect & bit)) {
+		log_prio(LOG_ERR);
+		print_str_P(PSTR("sensor disagrees with the model: "));
+		print_str_P(sensor ? PSTR("probe\n") : PSTR("air\n"));
+		log_prio(LOG_INFO);
+	}
+	suspect |= bit;
+
+	// trust the reading again, otherwise the model runs on its own forever
+	P[i][i] += KQ(KF_P0);
+}
+
+void kalman_step(fp16 air, fp16 probe, bool has_probe, fp16 power)
+{
+	PROF_SCOPE(PROF_KALMAN);
+	if (n_steps == 0)
+		reset((int32_t)air.raw << (Q_X - FP_FRAC));
+
+	// Without the probe the air reading can't tell a warmer room from the
+	// heat of fermentation. The ambient is then an input at its estimate.
+	int32_t p_amb = P[AMB][AMB];
+	if (!has_probe)
+		for (uint8_t j=0; j<N_X; j++)
+			P[j][AMB] = P[AMB][j] = 0;
+
+	if (n_steps > 0) {
+		measure(0, AIR, air, has_probe);
+		if (has_probe)
+			measure(1, TEMPEH, probe, true);
+	}
+
+	// heater duty 0 ... 1 [Q16]
+	int32_t u = ((int32_t)power.raw << (Q_X - FP_FRAC)) / 0xFF;
+	predict(u);
+	if (!has_probe)
+		P[AMB][AMB] = p_amb;
+
+	if (n_steps < 0xFFFF)
+		n_steps++;
+}
+
+fp16 kalman_tempeh()
+{
+	return fp16::from_raw(x[TEMPEH] >> (Q_X - FP_FRAC));
+}
+
+bool kalman_valid()
+{
+	return n_steps >= KF_N_VALID;
+}
+
+uint8_t kalman_suspect()
+{
+	return suspect;
+}
+
+// name in flash
+static void print_state(const char *name, uint8_t i)
+{
+	print_str_P(name);
+	print_dec_fix(x[i] >> (Q_X - FP_FRAC), FP_FRAC, 2);
+}
+
+void kalman_print()
+{
+	print_state(PSTR("kalman plate "), PLATE);
+	print_state(PSTR(" air "), AIR);
+	print_state(PSTR(" tempeh "), TEMPEH);
+	print_state(PSTR(" ambient "), AMB);
+	print_str_P(PSTR(" C, var "));
+	print_dec_fix(P[TEMPEH][TEMPEH] >> (Q_P - FP_FRAC), FP_FRAC, 2);
+	if (suspect & KF_SUSPECT_AIR)
+		print_str_P(PSTR(", air suspect"));
+	if (suspect & KF_SUSPECT_PROBE)
+		print_str_P(PSTR(", probe suspect"));
+	print_str_P(PSTR("\n"));
+}
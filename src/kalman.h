@@ -0,0 +1,77 @@
+#ifndef KALMAN_H
+#define KALMAN_H
+#include <stdint.h>
+#include "pid.h"
+
+// Virtual tempeh sensor: Kalman filter on a lumped model of the box
+//   heater plate --> air --> ambient (styrofoam and hatch)
+//                       \--> tempeh
+// driven by the heater power. It estimates the tempeh temperature from
+// the air sensor alone and fuses the probe reading if there is one.
+// The ambient temperature is a slowly drifting state as well, it is
+// identified while the probe is connected.
+// A sensor whose readings stay off the prediction is flagged.
+
+// Model, per Kelvin and Watt. Defaults are those of tools/thermal_sim.cpp
+#define KF_P_HEATER 10.0  // heater power at full PWM [W]
+#define KF_C_PLATE 100.0  // heat capacity [J / K]
+#define KF_C_AIR 50.0
+#define KF_C_TEMPEH 3000.0
+#define KF_G_PLATE_AIR 0.5  // thermal conductance [W / K]
+#define KF_G_AIR_AMB 0.15
+#define KF_G_HATCH 0.4  // with the hatch fully open
+#define KF_G_AIR_TEMPEH 0.5
+
+// The ambient temperature starts at the first air reading, the box is
+// assumed to be at room temperature at power-up. The limits keep a reset in
+// a warm box from biasing the estimate too much: without the probe an
+// ambient error of 5 degC biases it by ~1.5 degC.
+#define KF_T_AMB_MIN FP(15.0)
+#define KF_T_AMB_MAX FP(25.0)
+
+// Process noise per control cycle [K^2], the tempeh one covers the heat
+// of fermentation
+#define KF_Q_PLATE 1e-4
+#define KF_Q_AIR 1e-5
+#define KF_Q_TEMPEH 1e-4
+#define KF_Q_AMB 1e-6
+
+// Measurement noise [K^2]
+#define KF_R 0.04
+
+// Initial variance of the states [K^2]
+#define KF_P0 4.0
+#define KF_P0_AMB 25.0
+
+// With both sensors, a reading more than KF_GATE standard deviations off
+// the prediction is not used, after KF_N_SUSPECT of them in a row the
+// sensor is flagged. The flag is cleared after KF_N_AGREE readings in a
+// row inside the gate.
+#define KF_GATE 5
+#define KF_N_SUSPECT 60
+#define KF_N_AGREE 600
+
+// Control cycles until the estimate is used
+#define KF_N_VALID 600
+
+// Bits of kalman_suspect()
+#define KF_SUSPECT_AIR 1
+#define KF_SUSPECT_PROBE 2
+
+// Call this once per control cycle with the readings and the heater power
+// applied from now on. The probe is ignored if has_probe is false.
+void kalman_step(fp16 air, fp16 probe, bool has_probe, fp16 power);
+
+// Estimated tempeh temperature
+fp16 kalman_tempeh();
+
+// true when the estimate has settled
+bool kalman_valid();
+
+// Sensors which disagree with the model, KF_SUSPECT_* bits
+uint8_t kalman_suspect();
+
+// Print the state
+void kalman_print();
+
+#endif
@@ -7,42 +7,146 @@
 #include "print.h"
 #include "main.h"
 #include "pid.h"
+#include "ee_store.h"
+#include "hatch.h"
+#include "sched.h"
+#include "uart_log.h"
+#include "telemetry.h"
+#include "rls.h"
+#include "kalman.h"
+#include "hist.h"
+#include "prof.h"
+#include "sram.h"
 
 // process time
 uint32_t ms_since_start = 0;
 
-#define MAX_HATCH 55
+void open_hatch()
+{
+	// don't open hatch within first 1 h
+	if (ms_since_start < (1000L * 60 * 60))
+		return;
+
+	if (measured_probe_temperature > target_probe_temperature + fp16::from(3.0))
+		hatch_move(1);
+	else if (measured_probe_temperature < target_probe_temperature)
+		hatch_move(-MAX_HATCH);
+}
+
+// --------------------------------------------------------------
+//  Tasks
+// --------------------------------------------------------------
+static void task_control(unsigned long ts_now)
+{
+	pid_cycle();
+	open_hatch();
+	prof_cycle();
+	sram_check();
+
+	// keep track of process time
+	static unsigned long last_ms = 0;
+	ms_since_start += ts_now - last_ms;
+	last_ms = ts_now;
+}
+
+static void task_gui(unsigned long ts_now)
+{
+	gui(ts_now);
+}
+
+static void task_save(unsigned long ts_now)
+{
+	store_ee(ms_since_start, SL_MS_SINCE_START);
+}
 
-void set_motor(int8_t amount)
+static void task_invert(unsigned long ts_now)
 {
-	static int16_t current_pos = 0;
+	ssd_invert();
+}
 
-	int16_t target = current_pos + amount;
-	if (target < 0)
-		target = 0;
-	else if (target > MAX_HATCH)
-		target = MAX_HATCH;
+static void task_log(unsigned long ts_now)
+{
+	log_flush();
+}
 
-	amount = target - current_pos;
-	if (amount == 0) {
+// single character commands on the serial port
+static void task_commands(unsigned long ts_now)
+{
+	if (!Serial.available())
 		return;
-	} else if (amount < 0) {
-		digitalWrite(PIN_MOTOR_DIRECTION, HIGH);
-		delay(100);
-		amount = -amount;
-	}
 
-	for (uint8_t i=0; i<amount; i++) {
-		digitalWrite(PIN_MOTOR_ENABLE, HIGH);
-		delay(250);
+	// the dumps are longer than the log buffer
+	log_blocking(true);
+	switch (Serial.read()) {
+	case 's':
+		sched_dump();
+		break;
+
+	case 'b':
+		// toggle binary telemetry
+		telemetry_binary = !telemetry_binary;
+		break;
+
+	case 'm':
+		rls_print();
+		break;
+
+	case 'g': {
+		// use the gains derived from the identified model
+		int32_t kp, ki;
+		if (rls_gains(&kp, &ki))
+			pid_set_air_gains(kp, ki);
+		rls_print();
+		break;
 	}
 
-	digitalWrite(PIN_MOTOR_ENABLE, LOW);
-	digitalWrite(PIN_MOTOR_DIRECTION, LOW);
-	current_pos = target;
-	print_str("Hatch @ "); print_dec(current_pos); print_str("\n");
+	case 'k':
+		kalman_print();
+		break;
+
+	case 'h':
+		hist_print();
+		break;
+
+	case 'f':
+		pid_print_filters();
+		break;
+
+	case 'p':
+		prof_print();
+		print_str_P(PSTR("display update "));
+		print_udec(ssd_bytes_sent);
+		print_str_P(PSTR(" bytes\n"));
+		break;
+
+	case 'l':
+		print_str_P(PSTR("log dropped err / info / debug: "));
+		for (uint8_t i=0; i<LOG_N_PRIOS; i++) {
+			print_udec(log_dropped[i]);
+			print_str_P(PSTR(" "));
+		}
+		print_str_P(PSTR("\n"));
+		break;
+	}
+	log_blocking(false);
 }
 
+// In order of priority
+static const struct task tasks[] PROGMEM = {
+	// function, period, phase, deadline [ms], name
+	{task_control, CYCLE_TIME, 0, 100, "control"},
+	{hatch_tick, 10, 0, 10, "hatch"},
+	{buttons, 2, 0, 5, "buttons"},
+	{task_log, 5, 0, 5, "log"},
+	{task_gui, CYCLE_TIME, 0, 500, "gui"},
+	{task_commands, 50, 0, 50, "cmd"},
+	// save some values to EEPROM every 10 min
+	{task_save, 600000UL, 600000UL, 1000, "save"},
+	// invert display every 1 h
+	{task_invert, 3600000UL, 3600000UL, 1000, "invert"},
+};
+#define N_TASKS (sizeof(tasks) / sizeof(tasks[0]))
+static_assert(N_TASKS <= SCHED_MAX_TASKS, "raise SCHED_MAX_TASKS");
 
 void setup()
 {
@@ -61,84 +165,44 @@ void setup()
 	pinMode(PIN_MID, INPUT_PULLUP);
 
 	Serial.begin(115200);
-	print_str("Yo! This is Tempeh Temperer!\n");
+	print_str_P(PSTR("Yo! This is Tempeh Temperer!\n"));
 
 	i2c_init();
 
-	print_str("I2C: ");
+	print_str_P(PSTR("I2C: "));
 	for (unsigned i=0; i<127; i++) {
 		uint8_t ret = i2c_start(i << 1);
 		i2c_stop();
 		if (ret == 0) {
-			print_hex(i, 2); print_str(" ");
+			print_hex(i, 2); print_str_P(PSTR(" "));
 		}
 	}
-	print_str("\n");
+	print_str_P(PSTR("\n"));
 
 	ssd_init();
 	// Set random display inverted state on power-up
 	if (analogRead(0) & 1)
 		ssd_invert();
 
+	ee_init();
 	pid_init();
+	// Timer1 is set up by the 1-wire driver
+	prof_init();
 
 	if (!load_ee((int32_t*)(&ms_since_start), SL_MS_SINCE_START)) {
 		ms_since_start = 0;
 		store_ee(ms_since_start, SL_MS_SINCE_START);
 	}
-}
-
-void open_hatch()
-{
-	// don't open hatch within first 1 h
-	if (ms_since_start < (1000L * 60 * 60))
-		return;
-
-	if (measured_probe_temperature > target_probe_temperature + FP(3.0))
-		set_motor(1);
-	else if (measured_probe_temperature < target_probe_temperature)
-		set_motor(-100);
-}
-
-void every_cycle(unsigned long ts_now)
-{
-	static unsigned cycle = 0;
-
-	pid_cycle();
-	open_hatch();
-
-	// Here's a good place to do things which are blocking for a while
-	gui(ts_now);
-
-  	// save some values to EEPROM every 10 min
-	if (cycle > 0 && (cycle % 600) == 0) {
-		store_ee(ms_since_start, SL_MS_SINCE_START);
-	}
 
-	// invert display every 1 h
-	if (cycle > 0 && (cycle % 3600) == 0)
-	    ssd_invert();
+	hatch_init();
 
-	// keep track of process time
-	static unsigned long last_ms = 0;
-	ms_since_start += ts_now - last_ms;
-	last_ms = ts_now;
+	sched_init(tasks, N_TASKS, millis());
 
-	cycle++;
+	// from now on, drop log output rather than stalling the tasks
+	log_blocking(false);
 }
 
 void loop()
 {
-	static unsigned long ts_next = 0;
-
-	unsigned long ts_now = millis();
-
-	if (ts_now >= ts_next) {
-		ts_next = ts_now + CYCLE_TIME;
-		// called at 1 Hz
-		every_cycle(ts_now);
-	}
-
-	// Called as fast as possible
-	buttons(ts_now);
+	sched_run(millis());
 }
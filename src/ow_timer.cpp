@@ -0,0 +1,224 @@
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "ow_timer.h"
+#include "main.h"
+#include "prof.h"
+
+// Port access from the ISR, PIN_ONE_WIRE is PB1 / PCINT1
+#if PIN_ONE_WIRE != 9
+	#error "ow_timer.cpp only supports PIN_ONE_WIRE = 9"
+#endif
+#define OW_MASK (1 << 1)
+
+// the external pull-up keeps the bus high when released
+#define BUS_LOW() do { PORTB &= ~OW_MASK; DDRB |= OW_MASK; } while (0)
+#define BUS_POWER() do { PORTB |= OW_MASK; DDRB |= OW_MASK; } while (0)
+#define BUS_RELEASE() do { DDRB &= ~OW_MASK; PORTB &= ~OW_MASK; } while (0)
+#define BUS_READ() (PINB & OW_MASK)
+
+// Timer1 ticks for a duration in [us]
+#define US(t) ((uint16_t)((t) * (F_CPU / 1000000UL)))
+
+// from the compare match to the first port access in the ISR
+#define T_ISR US(3)
+
+// time slot [us]: the slave samples / drives the bus until T_SAMPLE after
+// the falling edge, the next slot starts T_SLOT after it
+#define T_SAMPLE 15
+#define T_SLOT 65
+
+enum OW_STATES {
+	ST_RESET,  // bus is pulled low for the reset pulse
+	ST_PRESENCE,  // waiting for the presence pulse
+	ST_SLOT,  // start the next time slot
+	ST_W0_END,  // end of the low phase of a 0 bit
+	ST_READ  // sample the bit of a read slot
+};
+
+static struct ow_xfer * volatile q[OW_QUEUE_LEN];
+static volatile uint8_t q_head = 0, q_tail = 0;
+static volatile bool q_active = false;
+static volatile bool presence = false;
+
+static uint8_t state;
+static uint8_t n_byte;  // index of the current byte
+static uint8_t bit_mask;  // current bit, LSB first
+static uint8_t cur;  // byte being read
+static uint16_t t_slot;  // falling edge of the current slot [Timer1]
+
+static void schedule(uint16_t ticks)
+{
+	OCR1A = TCNT1 + ticks;
+}
+
+static void start_reset()
+{
+	BUS_LOW();
+	state = ST_RESET;
+	schedule(US(480));
+}
+
+static void xfer_done(struct ow_xfer *x, uint8_t status)
+{
+	x->status = status;
+	q_tail = (q_tail + 1) % OW_QUEUE_LEN;
+
+	if (q_tail != q_head) {
+		start_reset();
+		return;
+	}
+
+	TIMSK1 &= ~(1 << OCIE1A);
+	q_active = false;
+}
+
+static void next_bit(struct ow_xfer *x)
+{
+	bit_mask <<= 1;
+	if (bit_mask)
+		return;
+
+	if (n_byte >= x->n_tx)
+		x->rx[n_byte - x->n_tx] = cur;
+
+	bit_mask = 1;
+	cur = 0;
+	n_byte++;
+
+	// strong pull-up within 10 us after the last bit
+	if (n_byte >= x->n_tx + x->n_rx && (x->flags & OW_POWER))
+		BUS_POWER();
+}
+
+ISR(PCINT0_vect)
+{
+	if (!BUS_READ())
+		presence = true;
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+#ifdef PROF
+	// a time stamp here would delay the slot timing
+	uint16_t t_match = OCR1A;
+#endif
+	struct ow_xfer *x = q[q_tail];
+
+	switch (state) {
+	case ST_RESET:
+		BUS_RELEASE();
+		presence = false;
+		PCIFR = (1 << PCIF0);
+		PCMSK0 |= OW_MASK;
+		PCICR |= (1 << PCIE0);
+		state = ST_PRESENCE;
+		schedule(US(480));
+		break;
+
+	case ST_PRESENCE:
+		PCMSK0 &= ~OW_MASK;
+		if (!presence) {
+			xfer_done(x, OW_NO_PRESENCE);
+			break;
+		}
+		n_byte = 0;
+		bit_mask = 1;
+		cur = 0;
+		state = ST_SLOT;
+		schedule(US(10));
+		break;
+
+	case ST_SLOT:
+		if (n_byte >= x->n_tx + x->n_rx) {
+			xfer_done(x, OW_OK);
+			break;
+		}
+
+		BUS_LOW();
+		t_slot = TCNT1;
+
+		// read slots are write 1 slots where the slave may pull low
+		if (n_byte < x->n_tx && !(x->tx[n_byte] & bit_mask)) {
+			state = ST_W0_END;
+			OCR1A = t_slot + US(60);
+			break;
+		}
+
+		// the register accesses above kept the bus low for > 1 us
+		if (n_byte >= x->n_tx) {
+			state = ST_READ;
+			OCR1A = t_slot + US(T_SAMPLE - 2) - T_ISR;
+			BUS_RELEASE();
+			break;
+		}
+		BUS_RELEASE();
+		next_bit(x);
+		OCR1A = t_slot + US(T_SLOT);
+		break;
+
+	case ST_READ:
+		// held up by other interrupts, the slave may have released the bus
+		// already. The slots can't be repeated, so give up.
+		if ((uint16_t)(TCNT1 - t_slot) > US(T_SAMPLE)) {
+			xfer_done(x, OW_LATE);
+			break;
+		}
+		if (BUS_READ())
+			cur |= bit_mask;
+		next_bit(x);
+		state = ST_SLOT;
+		OCR1A = t_slot + US(T_SLOT);
+		break;
+
+	case ST_W0_END:
+		BUS_RELEASE();
+		next_bit(x);
+		state = ST_SLOT;
+		schedule(US(10));
+		break;
+	}
+
+#ifdef PROF
+	// the other interrupts were held off from the compare match on
+	prof_add(PROF_OW, (uint16_t)(TCNT1 - t_match));
+#endif
+}
+
+void ow_init()
+{
+	// Timer1 free-running at F_CPU, normal mode
+	TCCR1A = 0;
+	TCCR1B = (1 << CS10);
+	TIMSK1 &= ~(1 << OCIE1A);
+}
+
+uint8_t ow_queue(struct ow_xfer *x)
+{
+	uint8_t sreg = SREG;
+	cli();
+
+	uint8_t next = (q_head + 1) % OW_QUEUE_LEN;
+	if (next == q_tail) {
+		SREG = sreg;
+		return 1;
+	}
+	x->status = OW_BUSY;
+	q[q_head] = x;
+	q_head = next;
+
+	if (!q_active) {
+		q_active = true;
+		start_reset();
+		TIFR1 = (1 << OCF1A);
+		TIMSK1 |= (1 << OCIE1A);
+	}
+
+	SREG = sreg;
+	return 0;
+}
+
+bool ow_busy()
+{
+	return q_active;
+}
@@ -0,0 +1,45 @@
+#ifndef OW_TIMER_H
+#define OW_TIMER_H
+#include <stdint.h>
+
+// Timer driven, non-blocking 1-wire master on PIN_ONE_WIRE.
+// Time slots are scheduled with the Timer1 compare A interrupt, the
+// presence pulse is detected with the pin-change interrupt. The ISR never
+// waits, each step of a slot is an interrupt of its own. With PROF the
+// `ow isr` probe shows how long it keeps the other interrupts off.
+//
+// Timer1 is left free-running at F_CPU.
+
+// One transaction: reset, write n_tx bytes, then read n_rx bytes
+struct ow_xfer {
+	const uint8_t *tx;
+	uint8_t n_tx;
+	uint8_t *rx;
+	uint8_t n_rx;
+	uint8_t flags;  // OW_* bits
+	volatile uint8_t status;  // OW_BUSY, OW_OK, ...
+};
+
+// drive the bus high after the last byte (parasite powered conversion)
+#define OW_POWER (1 << 0)
+
+#define OW_OK 0
+#define OW_NO_PRESENCE 1
+// a read slot was sampled too late, other interrupts held the ISR up
+#define OW_LATE 2
+#define OW_BUSY 0xFF
+
+// size of the transaction ring buffer, up to OW_QUEUE_LEN - 1 can be queued
+#define OW_QUEUE_LEN 4
+
+// Call this once
+void ow_init();
+
+// Queue a transaction, x must stay valid until x->status != OW_BUSY
+// returns 0 on success, 1 if the queue is full
+uint8_t ow_queue(struct ow_xfer *x);
+
+// true while transactions are pending
+bool ow_busy();
+
+#endif
@@ -1,106 +1,231 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <Arduino.h>
-#include <EEPROM.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
 #include "pid.h"
+#include "ee_store.h"
 #include "temp_sensor.h"
+#include "ow_timer.h"
+#include "uart_log.h"
+#include "telemetry.h"
+#include "autotune.h"
+#include "rls.h"
+#include "kalman.h"
+#include "hist.h"
+#include "prof.h"
 #include "print.h"
 #include "main.h"
 
 
-int16_t measured_air_temperature = 0;
-int16_t measured_probe_temperature = 0;
+fp16 measured_air_temperature = {0};
+fp16 measured_probe_temperature = {0};
 
-int16_t target_heater_power = 0;
-int16_t target_air_temperature = 0;
-int16_t target_probe_temperature = 0;
+fp16 target_heater_power = {0};
+fp16 target_air_temperature = {0};
+fp16 target_probe_temperature = {0};
 
 bool heater_enabled = false;
+uint16_t temp_misses = 0;
 
-static int32_t probe_i_val = 0;
-static int32_t air_i_val = 0;
+static fp32_i8 probe_i_val = {0};
+static fp32 air_i_val = {0};
+
+// auto-tuned air loop gains, replace the compile time ones if valid
+static bool air_tuned = false;
+static fp32 air_kp_tuned, air_ki_tuned;
+
+// log of the current cycle
+static struct telemetry tm;
+
+static temp_filter filter_air, filter_probe;
+
+#ifdef HEATER_DITHER
+// PWM duty with the fractional bits, 0 ... POWER_MAX_LIMIT
+static volatile uint16_t heater_duty = 0;
+
+// First order sigma-delta: the fractional part of the duty accumulates,
+// every time it overflows the next PWM period gets one unit more
+ISR(TIMER2_OVF_vect)
+{
+	static uint8_t acc = 0;
+	uint16_t duty = heater_duty;
+	uint8_t val = duty >> FP_FRAC;
+
+	acc += duty & (FP_SCALE - 1);
+	if (acc >= FP_SCALE) {
+		acc -= FP_SCALE;
+		val++;
+	}
+	OCR2B = val;
+}
+
+static void set_duty(uint16_t duty)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		heater_duty = duty;
+	}
+}
+#endif
 
 // val is 0 ... 255
-static void set_heater(int16_t val)
+static void set_heater(fp16 power)
 {
 	if (!heater_enabled) {
+#ifdef HEATER_DITHER
+		set_duty(0);
+#endif
 		OCR2B = 0;
 		return;
 	}
 
-	val = (val + FP_ROUND) >> FP_FRAC;
-
-	if (val < 0)
-		val = 0;
+	power = power.clamp(fp16::from_raw(0), fp16::from_raw(POWER_MAX_LIMIT));
 
-	if (val > 0xFF)
-		val = 0xFF;
-
-	OCR2B = val;
+#ifdef HEATER_DITHER
+	// no fraction at full power, the ISR can not overflow OCR2B
+	set_duty(power.raw);
+#else
+	OCR2B = power.to<0>().raw;
+#endif
 }
 
 // Sets target heater power
 void pid_air_step()
 {
-	const int32_t air_kp = (n_sensors >= 2) ? AIR_KP_DUAL : AIR_KP_SINGLE;
-	const int32_t air_ki = (n_sensors >= 2) ? AIR_KI_DUAL : AIR_KI_SINGLE;
+	const fp32 p_min = fp32::from_raw(POWER_MIN_LIMIT);
+	const fp32 p_max = fp32::from_raw(POWER_MAX_LIMIT);
+
+	fp32 air_kp = fp32::from_raw((n_sensors >= 2) ? AIR_KP_DUAL : AIR_KP_SINGLE);
+	fp32 air_ki = fp32::from_raw((n_sensors >= 2) ? AIR_KI_DUAL : AIR_KI_SINGLE);
+
+	if (air_tuned) {
+		air_kp = air_kp_tuned;
+		air_ki = air_ki_tuned;
+	}
 
 	// Calculate error term
-	int32_t err = target_air_temperature - measured_air_temperature;
+	fp32 err = target_air_temperature.as<int32_t>() - measured_air_temperature.as<int32_t>();
 
 	// Proportional term, output sum with limiter
-	int32_t p_val = (err * air_kp + FP_ROUND) >> FP_FRAC;
+	fp32 p_val = err.mul(air_kp);
 
 	// Integral term (from linear error)
-	if (abs(err) > FP(1.5)) {
+	if (err.abs() > fp32::from(1.5)) {
 		// Leave at half power if we are further than 1.5 C away from target
-		air_i_val = (POWER_MIN_LIMIT + POWER_MAX_LIMIT) / 2;
+		air_i_val = (p_min + p_max) / 2;
 	} else {
-		air_i_val += (err * air_ki + FP_ROUND) >> FP_FRAC;
-		air_i_val = limit(air_i_val, POWER_MIN_LIMIT, POWER_MAX_LIMIT);
+		air_i_val += err.mul(air_ki);
+		air_i_val = air_i_val.clamp(p_min, p_max);
 	}
 
-	print_str("ai ");
-	print_dec_fix(air_i_val, FP_FRAC, 2);
-	print_str(", ");
-
-	print_str("ap ");
-	print_dec_fix(p_val, FP_FRAC, 2);
-	print_str(", ");
+	tm.air_i = air_i_val.raw;
+	tm.air_p = p_val.raw;
 
-	target_heater_power = limit(p_val + air_i_val, POWER_MIN_LIMIT, POWER_MAX_LIMIT);
+	target_heater_power = (p_val + air_i_val).clamp(p_min, p_max).as<int16_t>();
 }
 
+#ifdef PROBE_SMITH
+// per control cycle
+#define TAU_CYCLES (PROBE_TAU * 1000L / CYCLE_TIME)
+#define TI_CYCLES (PROBE_TI_SMITH * 1000L / CYCLE_TIME)
+#define DECIM_CYCLES (PROBE_DECIM * 1000L / CYCLE_TIME)
+#define N_HIST (PROBE_DEAD / PROBE_DECIM)
+
+// model output and integrator with 8 more fractional bits
+typedef fixed<int32_t, FP_FRAC + 8> fp32_x;
+static fp32_x model;
+static fp32_x smith_i;
+
+// model output delayed by PROBE_DEAD, one sample per PROBE_DECIM
+static fp16 model_hist[N_HIST];
+static uint8_t hist_pos = 0;
+static uint8_t hist_cycle = 0;
+static bool model_valid = false;
+
+// Returns target air temperature
+void pid_probe_step()
+{
+	const fp32 t_min = fp32::from_raw(AIR_MIN_LIMIT);
+	const fp32 t_max = fp32::from_raw(AIR_MAX_LIMIT);
+
+	// start in steady state at the current reading
+	if (!model_valid) {
+		for (uint8_t i=0; i<N_HIST; i++)
+			model_hist[i] = measured_probe_temperature;
+		model = measured_probe_temperature.as<int32_t>().to<FP_FRAC + 8>();
+		smith_i = probe_i_val.clamp(t_min.to<FP_FRAC + 3>(), t_max.to<FP_FRAC + 3>()).to<FP_FRAC + 8>();
+		model_valid = true;
+	}
+
+	// measured reading + what the model expects to arrive within the dead time
+	fp16 predicted = measured_probe_temperature + model.trunc<FP_FRAC>().as<int16_t>() - model_hist[hist_pos];
+	fp32 err = target_probe_temperature.as<int32_t>() - predicted.as<int32_t>();
+
+	fp32 p_val = err.mul(fp32::from_raw(PROBE_KP_SMITH));
+
+	// no integration while the output is pegged (anti-windup)
+	fp32 out = p_val + smith_i.trunc<FP_FRAC>();
+	if ((out < t_max || p_val.raw < 0) && (out > t_min || p_val.raw > 0)) {
+		smith_i += p_val.to<FP_FRAC + 8>() / TI_CYCLES;
+		smith_i = smith_i.clamp(t_min.to<FP_FRAC + 8>(), t_max.to<FP_FRAC + 8>());
+	}
+
+	// same scaling as the non-compensated loop, for EEPROM and telemetry
+	probe_i_val = smith_i.trunc<FP_FRAC + 3>();
+
+	tm.probe_i = probe_i_val.raw;
+	tm.probe_p = p_val.raw;
+
+	target_air_temperature = (p_val + smith_i.trunc<FP_FRAC>()).clamp(t_min, t_max).as<int16_t>();
+
+	// advance the model with the new set-point
+	model += (target_air_temperature.as<int32_t>().to<FP_FRAC + 8>() - model) / TAU_CYCLES;
+
+	if (++hist_cycle >= DECIM_CYCLES) {
+		hist_cycle = 0;
+		model_hist[hist_pos] = model.trunc<FP_FRAC>().as<int16_t>();
+		hist_pos = (hist_pos + 1) % N_HIST;
+	}
+}
+#else
 // Returns target air temperature
 void pid_probe_step()
 {
+	const fp32 t_min = fp32::from_raw(AIR_MIN_LIMIT);
+	const fp32 t_max = fp32::from_raw(AIR_MAX_LIMIT);
+
 	// Calculate error term
-	int32_t err = target_probe_temperature - measured_probe_temperature;
+	fp32 err = target_probe_temperature.as<int32_t>() - measured_probe_temperature.as<int32_t>();
 
 	// Proportional term
-	int32_t p_val = (err * PROBE_KP + FP_ROUND) >> FP_FRAC;
-	// p_val = limit(p_val, AIR_MIN_LIMIT - 1, AIR_MAX_LIMIT + 1);
+	fp32 p_val = err.mul(fp32::from_raw(PROBE_KP));
+	// p_val = p_val.clamp(t_min - 1, t_max + 1);
 
 	// Integral term (from linear error)
-	if (abs(err) > FP(0.3)) {
+	if (err.abs() > fp32::from(0.3)) {
 		// Reset the I-part if we are pegged
-		probe_i_val = target_probe_temperature * 8;
+		probe_i_val = target_probe_temperature.as<int32_t>().to<FP_FRAC + 3>();
 	} else {
 		// move I-term with the minimum increment possible
-		probe_i_val += err > 0 ? 1 : -1;  // (err * PROBE_KI + FP_ROUND) >> FP_FRAC;
-		probe_i_val = limit(probe_i_val, AIR_MIN_LIMIT * 8, AIR_MAX_LIMIT * 8);
+		probe_i_val += fp32_i8::from_raw(err.raw > 0 ? 1 : -1);  // err.mul(PROBE_KI)
+		probe_i_val = probe_i_val.clamp(t_min.to<FP_FRAC + 3>(), t_max.to<FP_FRAC + 3>());
 	}
 
-	print_str("pi ");
-	print_dec_fix(probe_i_val / 8, FP_FRAC, 2);
-	print_str(", ");
-
-	print_str("pp ");
-	print_dec_fix(p_val, FP_FRAC, 2);
-	print_str(", ");
+	tm.probe_i = probe_i_val.raw;
+	tm.probe_p = p_val.raw;
 
 	// Output sum with limiter
-	target_air_temperature = limit(p_val + probe_i_val / 8, AIR_MIN_LIMIT, AIR_MAX_LIMIT);
+	target_air_temperature = (p_val + probe_i_val.trunc<FP_FRAC>()).clamp(t_min, t_max).as<int16_t>();
+}
+#endif
+
+void pid_set_air_gains(int32_t kp, int32_t ki)
+{
+	air_kp_tuned = fp32::from_raw(kp);
+	air_ki_tuned = fp32::from_raw(ki);
+	air_tuned = true;
+	store_ee(kp, SL_AIR_KP);
+	store_ee(ki, SL_AIR_KI);
 }
 
 int32_t limit(int32_t val, int32_t a, int32_t b)
@@ -116,155 +241,161 @@ void pid_init()
 	// Phase correct PWM (mode 1), Non-inverted output, Enabled
 	TCCR2A = (1 << COM2B1) | (0 << COM2B0) | (1 << WGM20);
 	TCCR2A |= (1 << COM2B1);
+#ifdef HEATER_DITHER
+	// at BOTTOM, OCR2B is latched at the next TOP
+	TIMSK2 |= (1 << TOIE2);
+#endif
 
 	// Init one wire interface to temperature sensor
 	if (init_one_wire() != 0) {
-		print_str("Sensor error, disabling heater\n");
+		print_str_P(PSTR("Sensor error, disabling heater\n"));
 		heater_enabled = false;
 	} else {
 		heater_enabled = true;
 	}
 
-	conv_temp();
+	// Start a conversion, the stale readings are ignored
+	temp_request();
 
 	int32_t tmp_val = 0;
 
 	load_ee(&tmp_val, SL_T_SET);
-	target_probe_temperature = tmp_val;
+	target_probe_temperature = fp16::from_raw(tmp_val);
+
+	load_ee(&probe_i_val.raw, SL_I_VAL);
 
-	load_ee(&probe_i_val, SL_I_VAL);
+	air_tuned = load_ee(&air_kp_tuned.raw, SL_AIR_KP) &&
+	            load_ee(&air_ki_tuned.raw, SL_AIR_KI);
 
 	// Make sure a valid temp. readin is available in the first cycle
 	delay(CYCLE_TIME);
+	temp_request();
+	while (ow_busy());
 }
 
-static int16_t get_avg_temp(int16_t reading, int16_t *old_readings)
+// Keeps the last output if the filter dropped the reading
+static void filter_temp(temp_filter *f, ds_temp reading, fp16 *out)
 {
-	int16_t sum = 0;
+	fp16 val = reading.to<FP_FRAC>();
 
-	// Generate the sum
-	for (uint8_t i=0; i<(N_AVG - 1); i++)
-		sum += old_readings[i];
-	sum += reading;
+	if ((*f)(val))
+		*out = val;
+}
 
-	// Shift values towards higher indices
-	for (uint8_t i=(N_AVG - 2); i>0; i--)
-		old_readings[i] = old_readings[i - 1];
+static void print_filter(const temp_filter *f)
+{
+	uint16_t c[temp_filter::n_stages];
 
-	old_readings[0] = reading;
+	f->counters(c);
+	for (uint8_t i=0; i<temp_filter::n_stages; i++) {
+		print_str_P(PSTR(" "));
+		print_udec(c[i]);
+	}
+}
 
-	return (sum << (FP_FRAC - 4)) / N_AVG;
+void pid_print_filters()
+{
+	print_str_P(PSTR("filter rejects 85C / spike / rate / avg, air:"));
+	print_filter(&filter_air);
+	print_str_P(PSTR(" probe:"));
+	print_filter(&filter_probe);
+	print_str_P(PSTR(", late readings "));
+	print_udec(temp_misses);
+	print_str_P(PSTR("\n"));
 }
 
 // Call this with the cycle time
 void pid_cycle()
 {
+	PROF_SCOPE(PROF_PID);
 	static uint32_t cycle = 0;
-	static int16_t temperature_air[N_AVG - 1];
-	static int16_t temperature_probe[N_AVG - 1];
 
-	// Read the two one wire temp. sensors
-	int16_t tmp_air = 0, tmp_probe = 0;
-	uint8_t ret = read_temp(ds_addr_air, &tmp_air);
-
-	if (n_sensors >= 2)
-		ret |= read_temp(ds_addr_probe, &tmp_probe) << 4;
-
-	// Start the next temperature conversion already
-	ret |= conv_temp();
+	// Readings of the two one wire temp. sensors, queued in the last cycle
+	ds_temp tmp_air = {0}, tmp_probe = {0};
+	uint8_t ret = temp_collect(&tmp_air, &tmp_probe);
+
+	// a late slot or a transaction which isn't done yet: skip the cycle,
+	// the heater keeps its duty
+	static uint8_t n_miss = 0;
+	if (ret != 0 && temp_retry()) {
+		temp_misses++;
+		if (++n_miss < TEMP_N_MISS) {
+			temp_request();
+			return;
+		}
+	}
 
 	if (ret != 0) {
+		n_miss = 0;
 		heater_enabled = false;
-		set_heater(0);
+		set_heater(fp16::from_raw(0));
+		autotune_abort();
 
-		print_str("one wire error "); print_dec(ret); print_str("\n");
+		log_prio(LOG_ERR);
+		print_str_P(PSTR("one wire error ")); print_dec(ret); print_str_P(PSTR("\n"));
+		log_prio(LOG_INFO);
 
 		// TODO re-init freezes in ds.reset()  Why??
 		init_one_wire();
+		temp_request();
 		return;
 	}
 
+	n_miss = 0;
+
+	// Read the sensors and start the next conversion in the background.
+	// The readings are picked up in the next cycle.
+	temp_request();
+
 	// New temperature values are available
-	measured_air_temperature = get_avg_temp(tmp_air, temperature_air);
+	filter_temp(&filter_air, tmp_air, &measured_air_temperature);
 	if (n_sensors >= 2)
-		measured_probe_temperature = get_avg_temp(tmp_probe, temperature_probe);
+		filter_temp(&filter_probe, tmp_probe, &measured_probe_temperature);
 
-	// Wait for averaging to converge
+	// Wait for the median filter to fill up
 	if (cycle < N_AVG) {
 		cycle++;
 		return;
 	}
 
-	print_str("a ");
-	print_dec_fix(measured_air_temperature, FP_FRAC, 2);
-	print_str(" / ");
-	print_dec_fix(target_air_temperature, FP_FRAC, 2);
-	print_str(", ");
-
-	print_str("p ");
-	print_dec_fix(measured_probe_temperature, FP_FRAC, 2);
-	print_str(" / ");
-	print_dec_fix(target_probe_temperature, FP_FRAC, 2);
-	print_str(", ");
-
-	if (n_sensors >= 2)
-		pid_probe_step();
-	else
-		target_air_temperature = target_probe_temperature;
+	tm.air = measured_air_temperature.raw;
+	tm.air_set = target_air_temperature.raw;
+	tm.probe = measured_probe_temperature.raw;
+	tm.probe_set = target_probe_temperature.raw;
 
-	pid_air_step();
+	if (autotune_active()) {
+		// relay experiment on the air loop, the probe loop is paused
+		target_heater_power = fp16::from_raw(autotune_step(measured_air_temperature.raw));
+	} else {
+		if (n_sensors >= 2) {
+			pid_probe_step();
+#ifdef PROBE_VIRTUAL
+		} else if (kalman_valid()) {
+			measured_probe_temperature = kalman_tempeh();
+			pid_probe_step();
+#endif
+		} else {
+			target_air_temperature = target_probe_temperature;
+		}
+
+		pid_air_step();
+	}
 	set_heater(target_heater_power);
 
-	print_str("h ");
-	if (heater_enabled)
-		print_dec_fix(target_heater_power, FP_FRAC, 2);
-	else
-		print_str("off");
-	print_str("\n");
+	fp16 power = heater_enabled ? target_heater_power : fp16::from_raw(0);
+	rls_update(measured_air_temperature.raw, power.raw);
+	kalman_step(measured_air_temperature, measured_probe_temperature, n_sensors >= 2, power);
+	hist_update(measured_air_temperature, measured_probe_temperature, power);
+
+	tm.heater = target_heater_power.raw;
+	telemetry_send(&tm);
 
 	if ((cycle % 600) == 0) {
-		if (probe_i_val != 0)
-			store_ee(probe_i_val, SL_I_VAL);
-		if (air_i_val != 0)
-			store_ee(air_i_val, SL_I_VAL_AIR);
+		if (probe_i_val.raw != 0)
+			store_ee(probe_i_val.raw, SL_I_VAL);
+		if (air_i_val.raw != 0)
+			store_ee(air_i_val.raw, SL_I_VAL_AIR);
 	}
 
 	cycle++;
 }
-
-void store_ee(int32_t val, uint8_t slot)
-{
-	uint8_t sum = 0;
-	for (uint8_t i=0; i<=3; i++) {
-		EEPROM.write(i + (slot << 3), val & 0xFF);
-		sum += val & 0xFF;
-		val >>= 8;
-	}
-	EEPROM.write(4 + (slot << 3), sum);
-	print_str("stored ");
-	print_udec(slot);
-	print_str("\n");
-}
-
-bool load_ee(int32_t *val, uint8_t slot)
-{
-	int32_t tmp = 0;
-	uint8_t sum = 0;
-	for (uint8_t i=0; i<=3; i++) {
-		uint8_t r = EEPROM.read((3 - i) + (slot << 3));
-		sum += r;
-		tmp <<= 8;
-		tmp |= r;
-	}
-	if (EEPROM.read(4 + (slot << 3)) == sum) {
-		*val = tmp;
-		print_str("restored ");
-		print_udec(slot);
-		print_str("\n");
-		return true;
-	}
-	print_str("EEPROM read ");
-	print_udec(slot);
-	print_str(" failed\n");
-	return false;
-}
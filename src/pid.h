@@ -1,14 +1,34 @@
 #pragma once
+#include <stdint.h>
+#include "fixed.h"
+#include "filter.h"
 
+// ---------------------------------------------------------------
+//  Temperature filter, one per sensor (see filter.h)
+// ---------------------------------------------------------------
 // How many temperature values to average [cycles]
 #define N_AVG 4
 
+// The DS18B20 power-on value, always dropped
+#define POR_TEMP FP(85.0)
+
+// Count a reading as a spike if the median of 3 moved it by more than
+#define SPIKE_MIN FP(0.5)  // degC
+
+// Max. change of a reading per cycle
+#define RATE_MAX FP(1.0)  // degC
+
 // ---------------------------------------------------------------
 //  Inner loop which controls the heater PWM from air temperature
 // ---------------------------------------------------------------
 // Used in dual sensor mode
-#define AIR_KP_DUAL FP(150.0)  // PWM units / degC
-#define AIR_KI_DUAL FP(0.0)  // PWM units / degC / s
+// (the gains can be overridden by build flags, for the simulator)
+#ifndef AIR_KP_DUAL
+	#define AIR_KP_DUAL FP(150.0)  // PWM units / degC
+#endif
+#ifndef AIR_KI_DUAL
+	#define AIR_KI_DUAL FP(0.0)  // PWM units / degC / s
+#endif
 
 // only used in single sensor mode
 #define AIR_KP_SINGLE FP(75.0)
@@ -18,10 +38,36 @@
 #define POWER_MAX_LIMIT FP(0xFF)
 #define POWER_MIN_LIMIT FP(0x04)  // not 0 to keep powerbank from shutting down
 
+// Spread the fractional bits of the heater power over the PWM periods
+// (sigma-delta in the Timer2 overflow interrupt). On average the heater
+// gets 8 + FP_FRAC bits of resolution instead of 8.
+#define HEATER_DITHER
+
 // ---------------------------------------------------------------
 //  Outer loop which controls Tempeh probe temperature
 // ---------------------------------------------------------------
-#define PROBE_KP FP(10.0)  // degC / degC
+#ifndef PROBE_KP
+	#define PROBE_KP FP(10.0)  // degC / degC
+#endif
+
+// Dead time compensation (Smith predictor) for the probe loop.
+// A first order plus dead time model of the tempeh temperature, driven by
+// the air set-point, predicts the reading PROBE_DEAD into the future.
+// The loop is then a PI controller on that prediction.
+// #define PROBE_SMITH
+
+#define PROBE_TAU 6000  // time constant air -> tempeh [s]
+#define PROBE_DEAD 600  // heat propagation delay [s]
+#define PROBE_DECIM 30  // delay line resolution [s]
+
+#ifndef PROBE_KP_SMITH
+	#define PROBE_KP_SMITH FP(20.0)  // degC / degC
+#endif
+#define PROBE_TI_SMITH PROBE_TAU  // integral time [s]
+
+// Without a probe, control the tempeh temperature estimated by the Kalman
+// filter (kalman.h) instead of the air temperature.
+// #define PROBE_VIRTUAL
 
 // Air temperature set-point limits in [degC]
 #define AIR_MAX_LIMIT FP(38.0)
@@ -38,18 +84,33 @@
 #define FP_SCALE (1 << FP_FRAC)
 #define FP_ROUND (1 << (FP_FRAC - 1))
 
-// Convert floating point constant to fixed point
+// Convert floating point constant to fixed point (raw integer)
 #define FP(v) ((int32_t)(v * FP_SCALE + 0.5))
 
+// Temperatures [degC], heater power [PWM units] and gains
+typedef fixed<int16_t, FP_FRAC> fp16;
+typedef fixed<int32_t, FP_FRAC> fp32;
 
-extern int16_t measured_air_temperature;
-extern int16_t measured_probe_temperature;
+// probe loop integrator, scaled by 8
+typedef fixed<int32_t, FP_FRAC + 3> fp32_i8;
 
-extern int16_t target_probe_temperature;
-extern int16_t target_air_temperature;
-extern int16_t target_heater_power;
+typedef pipeline<
+	drop_value<fp16, POR_TEMP>,
+	median3<fp16, SPIKE_MIN>,
+	rate_limit<fp16, RATE_MAX>,
+	moving_avg<fp16, N_AVG>
+> temp_filter;
+
+extern fp16 measured_air_temperature;
+extern fp16 measured_probe_temperature;
+
+extern fp16 target_probe_temperature;
+extern fp16 target_air_temperature;
+extern fp16 target_heater_power;
 
 extern bool heater_enabled;
+// cycles skipped because a sensor reading was late or not done
+extern uint16_t temp_misses;
 
 // Call this once
 void pid_init();
@@ -57,19 +118,11 @@ void pid_init();
 // Call this with the cycle time
 void pid_cycle();
 
-// used EEPROM 32 bit slots
-enum EE_SLOTS {
-	SL_T_SET,
-	SL_I_VAL,
-	SL_MS_SINCE_START,
-	SL_I_VAL_AIR
-};
-
-// Store 32 bit value into EEPROM
-void store_ee(int32_t val, uint8_t slot);
+// Use and store auto-tuned air loop gains, fixed point per cycle
+void pid_set_air_gains(int32_t kp, int32_t ki);
 
-// load 32 bit value from EEPROM, returns true on success
-bool load_ee(int32_t *val, uint8_t slot);
+// Print the rejected samples of each filter stage
+void pid_print_filters();
 
 // Limit a value to [a, b]
 int32_t limit(int32_t val, int32_t a, int32_t b);
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <avr/pgmspace.h>
 #include "print.h"
 
 // Stub to prevent linker errors. User shall redefine this function!
@@ -13,14 +14,25 @@ void print_str(const char *p)
         _putchar(*(p++));
 }
 
-// returns number of characters written to buf
-static unsigned udec(uint32_t val, char *buf)
+void print_str_P(const char *p)
 {
-    char buffer[16];
+    char c;
+    while ((c = pgm_read_byte(p++)) != 0)
+        _putchar(c);
+}
+
+// There is no divide instruction on the AVR, a 32 bit / 10 is a library
+// call of several hundred cycles. The conversions below do without.
+
+unsigned udec16(uint16_t val, uint8_t n, char *buf)
+{
+    char buffer[5];
     char *p = buffer;
-    while (val || p == buffer) {
-        *(p++) = val % 10;
-        val = val / 10;
+    while (val || p - buffer < n) {
+        // val / 10, exact for all 16 bit values
+        uint16_t q = ((uint32_t)val * 0xCCCD) >> 19;
+        *(p++) = val - q * 10;
+        val = q;
     }
     unsigned ret = 0;
     while (p != buffer) {
@@ -31,13 +43,41 @@ static unsigned udec(uint32_t val, char *buf)
     return ret;
 }
 
+// the digits above 16 bit are found by subtracting powers of ten
+static const uint32_t pow10[] PROGMEM = {
+    1000000000, 100000000, 10000000, 1000000, 100000, 10000
+};
+
+// returns number of characters written to buf
+static unsigned udec(uint32_t val, char *buf)
+{
+    if (val <= 0xFFFF)
+        return udec16(val, 1, buf);
+
+    char *p = buf;
+    for (uint8_t i=0; i<sizeof(pow10) / sizeof(pow10[0]); i++) {
+        uint32_t k = pgm_read_dword(&pow10[i]);
+        char d = '0';
+        while (val >= k) {
+            val -= k;
+            d++;
+        }
+        if (d != '0' || p != buf)
+            *p++ = d;
+    }
+    // less than 10000 left
+    return p - buf + udec16(val, 4, p);
+}
+
 static void dec(int32_t val, char *buf)
 {
+    // unsigned, -INT32_MIN does not fit
+    uint32_t u = val;
     if (val < 0) {
-        val = -val;
+        u = -u;
         *buf++ = '-';
     }
-    udec(val, buf);
+    udec(u, buf);
 }
 
 void print_udec(uint32_t val)
@@ -62,16 +102,17 @@ void print_dec(int32_t val)
 // dp 4: .0130
 void udec_dp(uint32_t val, const uint8_t n, const uint8_t dp, char *buf)
 {
+    char digits[11];
+    unsigned len = udec(val, digits);
     char buffer[16], *p=buffer;
     unsigned i;
     for (i=0; i<n; i++) {
         if (i > 0 && i == dp)
             *p++ = '.';
-        if (val == 0 && i > dp)  // suppress leading zeros
-            *p++ = ' ';
+        if (i >= len)  // suppress leading zeros
+            *p++ = i > dp ? ' ' : '0';
         else
-            *p++ = '0' + val % 10;
-        val = val / 10;
+            *p++ = digits[len - 1 - i];
     }
     if (i == dp)
         *p++ = '.';
@@ -141,48 +182,50 @@ void print_dec_fix(int32_t val, const uint8_t nFract, uint8_t nDigits)
 
 void print_hex(uint32_t val, uint8_t digits)
 {
-    for (int i = (4*digits)-4; i >= 0; i -= 4)
-        _putchar("0123456789ABCDEF"[(val >> i) % 16]);
+    for (int i = (4*digits)-4; i >= 0; i -= 4) {
+        uint8_t d = (val >> i) % 16;
+        _putchar(d < 10 ? '0' + d : 'A' - 10 + d);
+    }
 }
 
 void hexDump(uint8_t *buffer, uint16_t nBytes)
 {
     for(uint16_t i=0; i<nBytes; i++) {
         if((nBytes > 16) && ((i % 16) == 0)) {
-            print_str("\n    ");
+            print_str_P(PSTR("\n    "));
             print_hex(i, 2);
-            print_str(": ");
+            print_str_P(PSTR(": "));
         }
         print_hex(*buffer++, 2);
-        print_str(" ");
+        print_str_P(PSTR(" "));
     }
-    print_str("\n");
+    print_str_P(PSTR("\n"));
 }
 
 void hexDump16(uint16_t *buffer, uint16_t nWords)
 {
     for(uint16_t i=0; i<nWords; i++) {
         if((nWords > 8) && ((i % 8) == 0)) {
-            print_str("\n    ");
+            print_str_P(PSTR("\n    "));
             print_hex(i * 2, 4);
-            print_str(": ");
+            print_str_P(PSTR(": "));
         }
         print_hex(*buffer++, 4);
-        print_str(" ");
+        print_str_P(PSTR(" "));
     }
-    print_str("\n");
+    print_str_P(PSTR("\n"));
 }
 
 void hexDump32(uint32_t *buffer, uint16_t nWords)
 {
     for(uint16_t i=0; i<nWords; i++) {
         if((nWords > 4) && ((i % 4) == 0)) {
-            print_str("\n    ");
+            print_str_P(PSTR("\n    "));
             print_hex(i * 4, 4);
-            print_str(": ");
+            print_str_P(PSTR(": "));
         }
         print_hex(*buffer++, 8);
-        print_str(" ");
+        print_str_P(PSTR(" "));
     }
-    print_str("\n");
+    print_str_P(PSTR("\n"));
 }
@@ -7,6 +7,8 @@
 
 #ifndef PRINT_H
 #define PRINT_H
+#include <stdint.h>
+#include "fixed.h"
 
 // Print a single character (see note above!)
 void _putchar(char c);
@@ -20,6 +22,10 @@ void print_dec(int32_t val);
 // Print an unsigned integer as decimal number
 void print_udec(uint32_t val);
 
+// 16 bit value to at least n decimal digits without a division, buf needs
+// 6 bytes. Returns the number of digits written
+unsigned udec16(uint16_t val, uint8_t n, char *buf);
+
 // convert to decimal with fixed number of digits + decimal point
 // ecample for val: 130, n: 4
 // dp 0:   130
@@ -38,9 +44,18 @@ void dec_fix(int32_t val, const uint8_t nFract, uint8_t nDigits, char *buf);
 void print_udec_fix(uint32_t val, const uint8_t nFract, uint8_t nDigits);
 void print_dec_fix(  int32_t val, const uint8_t nFract, uint8_t nDigits);
 
+template <typename T, uint8_t F>
+void print_fix(fixed<T, F> val, uint8_t nDigits)
+{
+	print_dec_fix(val.raw, F, nDigits);
+}
+
 // Print a zero terminated string
 void print_str(const char *p);
 
+// Print a zero terminated string from flash: print_str_P(PSTR("text"))
+void print_str_P(const char *p);
+
 // Print a memory region as 8-bit ordered hexdump
 void hexDump(uint8_t *buffer, uint16_t nBytes);
 
@@ -0,0 +1,127 @@
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include "prof.h"
+#include "print.h"
+#include "uart_log.h"
+#include "sram.h"
+
+#ifdef PROF
+
+static const char names[PROF_N][8] PROGMEM = {
+	"pid", "kalman", "temp", "gui", "ssd", "ee", "ow isr"
+};
+
+struct prof_stats {
+	uint32_t min, max;  // [cycles]
+	uint32_t total;
+	uint32_t n;  // the ISR probe counts every time slot
+};
+
+static struct prof_stats stats[PROF_N];
+
+// upper 16 bit of the time stamp
+static volatile uint16_t t1_ovf = 0;
+
+// cost of the time stamps themselves [cycles]
+static uint16_t overhead = 0;
+
+ISR(TIMER1_OVF_vect)
+{
+	t1_ovf++;
+}
+
+uint32_t prof_now()
+{
+	uint8_t sreg = SREG;
+	cli();
+	uint16_t lo = TCNT1;
+	uint16_t hi = t1_ovf;
+	// wrapped, but the interrupt did not run yet
+	if ((TIFR1 & (1 << TOV1)) && lo < 0x8000)
+		hi++;
+	SREG = sreg;
+	return ((uint32_t)hi << 16) | lo;
+}
+
+// PROF_OW is only added to in the ISR, the others only outside of it
+void prof_add(uint8_t id, uint32_t cycles)
+{
+	if (stats[id].n == 0 || cycles < stats[id].min)
+		stats[id].min = cycles;
+	if (cycles > stats[id].max)
+		stats[id].max = cycles;
+	stats[id].total += cycles;
+	stats[id].n++;
+}
+
+void prof_end(uint8_t id, uint32_t t0)
+{
+	uint32_t cycles = prof_now() - t0;
+	prof_add(id, cycles > overhead ? cycles - overhead : 0);
+}
+
+void prof_init()
+{
+	TIFR1 = (1 << TOV1);
+	TIMSK1 |= (1 << TOIE1);
+
+	uint32_t t0 = prof_now();
+	overhead = prof_now() - t0;
+}
+
+void prof_cycle()
+{
+#if PROF_REPORT > 0
+	static uint16_t n = 0;
+	if (++n >= PROF_REPORT) {
+		n = 0;
+		prof_print();
+	}
+#endif
+}
+
+void prof_print()
+{
+	// too much for the log buffer
+	log_blocking(true);
+	print_str_P(PSTR("probe         n     min     max     avg  [us]\n"));
+	for (uint8_t i=0; i<PROF_N; i++) {
+		char name[8];
+		memcpy_P(name, names[i], sizeof(name));
+		print_str(name);
+		for (uint8_t j=strlen(name); j<8; j++)
+			print_str_P(PSTR(" "));
+
+		// the ISR adds to its probe meanwhile
+		struct prof_stats st;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			st = stats[i];
+			memset(&stats[i], 0, sizeof(stats[i]));
+		}
+
+		print_udec_dp(st.n, 7, 0);
+		if (st.n > 0) {
+			const uint32_t k = F_CPU / 1000000;  // [cycles / us]
+			print_udec_dp(st.min * 10 / k, 8, 1);
+			print_udec_dp(st.max * 10 / k, 8, 1);
+			print_udec_dp(st.total / st.n * 10 / k, 8, 1);
+		}
+		print_str_P(PSTR("\n"));
+	}
+	sram_print();
+	log_blocking(false);
+}
+
+#else
+
+void prof_print()
+{
+	print_str_P(PSTR("profiler disabled, see PROF in prof.h\n"));
+	sram_print();
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef PROF_H
+#define PROF_H
+#include <stdint.h>
+
+// Cycle counting profiler. A probe times the rest of the enclosing scope
+// with Timer1, which ow_timer.cpp runs free at F_CPU, and keeps min / max /
+// total / count per probe:
+//   void pid_cycle() {
+//       PROF_SCOPE(PROF_PID);
+//       ...
+// Timer1 is only read, its overflow interrupt extends it to 32 bit.
+// Without PROF the probes compile to nothing.
+// #define PROF
+
+// Print the report every n control cycles, 0: only with the `p` command
+#define PROF_REPORT 0
+
+// Probes, in the order of the report
+enum PROF_PROBES {
+	PROF_PID,
+	PROF_KALMAN,
+	PROF_TEMP,
+	PROF_GUI,
+	PROF_SSD,
+	PROF_EE,
+	PROF_OW,  // Timer1 compare ISR of ow_timer.cpp
+	PROF_N
+};
+
+#ifdef PROF
+
+// Timer1 cycles since prof_init()
+uint32_t prof_now();
+
+// Add a measured duration [cycles] to a probe
+void prof_add(uint8_t id, uint32_t cycles);
+
+// Add the time since t0 = prof_now(), without the cost of the time stamps
+void prof_end(uint8_t id, uint32_t t0);
+
+struct prof_scope {
+	uint8_t id;
+	uint32_t t0;
+
+	prof_scope(uint8_t i) : id(i), t0(prof_now()) {}
+	~prof_scope() { prof_end(id, t0); }
+};
+
+#define PROF_SCOPE(id) prof_scope prof_scope_(id)
+
+// Call this once, after Timer1 is running
+void prof_init();
+
+// Call this once per control cycle
+void prof_cycle();
+
+#else
+
+#define PROF_SCOPE(id)
+
+static inline void prof_init() {}
+static inline void prof_cycle() {}
+
+#endif
+
+// Print the statistics of each probe and reset them
+void prof_print();
+
+#endif
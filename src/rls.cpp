@@ -0,0 +1,170 @@
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include "rls.h"
+#include "pid.h"
+#include "main.h"
+#include "print.h"
+
+// Fixed point formats
+//   regressors x, y: Q8   [degC, heater duty 0 .. 1, 1]
+//   parameters:      Q16
+//   covariance, gain Q24
+#define Q_X 8
+#define Q_TH 16
+#define Q_P 24
+
+#define P0 ((int32_t)(RLS_P0 * (1L << Q_P)))
+#define LAMBDA ((int32_t)(RLS_LAMBDA * (1L << Q_P) + 0.5))
+#define INV_LAMBDA ((int32_t)((1L << Q_P) / RLS_LAMBDA + 0.5))
+
+// estimator step [s]
+#define DT_S (RLS_DECIM * CYCLE_TIME / 1000L)
+
+// number of steps until the estimates are trusted
+#define N_VALID 32
+
+static int32_t theta[3];
+static int32_t P[3][3];
+static uint16_t n_steps = 0;
+
+// sums over the current and the previous window
+static int32_t sum_t = 0, sum_u = 0;
+static int32_t last_t, last_u;
+static uint8_t n_cycles = 0;
+static bool started = false;
+
+static void rls_step(const int32_t *x, int32_t y)
+{
+	int64_t px[3];
+	int64_t xpx = 0;
+	// a priori error [Q_X + Q_TH], at Q_X the truncation biased the fit
+	int64_t e = (int64_t)y << Q_TH;
+
+	// P x, x' P x and the a priori error
+	for (uint8_t i=0; i<3; i++) {
+		px[i] = 0;
+		for (uint8_t j=0; j<3; j++)
+			px[i] += (int64_t)P[i][j] * x[j];
+		px[i] >>= Q_X;
+		xpx += px[i] * x[i];
+		e -= (int64_t)theta[i] * x[i];
+	}
+	xpx >>= Q_X;
+
+	int64_t denom = LAMBDA + xpx;
+
+	// without excitation P grows by 1 / lambda every step, limit it
+	bool forget = P[0][0] + P[1][1] + P[2][2] < 3 * P0;
+
+	// gain P x / (lambda + x' P x), update parameters and covariance
+	int64_t k[3];
+	for (uint8_t i=0; i<3; i++) {
+		k[i] = (px[i] << Q_P) / denom;
+		// rounded, flooring drifts the small updates downwards
+		theta[i] += (k[i] * e + (1LL << (Q_P + Q_X - 1))) >> (Q_P + Q_X);
+	}
+
+	for (uint8_t i=0; i<3; i++) {
+		for (uint8_t j=i; j<3; j++) {
+			int64_t v = P[i][j] - ((k[i] * px[j]) >> Q_P);
+			if (forget)
+				v = (v * INV_LAMBDA) >> Q_P;
+			// keep it symmetric
+			P[i][j] = P[j][i] = v;
+		}
+	}
+
+	if (n_steps < 0xFFFF)
+		n_steps++;
+}
+
+void rls_update(int16_t temp, int16_t power)
+{
+	sum_t += temp;
+	sum_u += power;
+	if (++n_cycles < RLS_DECIM)
+		return;
+	n_cycles = 0;
+
+	if (!started) {
+		for (uint8_t i=0; i<3; i++) {
+			theta[i] = 0;
+			for (uint8_t j=0; j<3; j++)
+				P[i][j] = (i == j) ? P0 : 0;
+		}
+		started = true;
+	} else {
+		// regressors from the averages over the previous window,
+		// temperatures can be negative: multiply, don't shift
+		int32_t x[3];
+		x[0] = (last_t - RLS_T_REF * RLS_DECIM) * (1L << (Q_X - FP_FRAC)) / RLS_DECIM;
+		x[1] = (last_u << Q_X) / (RLS_DECIM * POWER_MAX_LIMIT);
+		x[2] = 1L << Q_X;
+		int32_t y = (sum_t - last_t) * (1L << (Q_X - FP_FRAC)) / RLS_DECIM;
+		rls_step(x, y);
+	}
+
+	last_t = sum_t;
+	last_u = sum_u;
+	sum_t = 0;
+	sum_u = 0;
+}
+
+bool rls_valid()
+{
+	if (n_steps < N_VALID || theta[0] >= 0 || theta[1] <= 0)
+		return false;
+
+	// time constant between one step and 10 h
+	return -theta[0] < (DT_S << Q_TH) && -theta[0] > (DT_S << Q_TH) / 36000;
+}
+
+void rls_model(int32_t *gain, int32_t *tau, int32_t *ambient)
+{
+	int32_t a1 = -theta[0];
+	*gain = ((int64_t)theta[1] << FP_FRAC) / a1;
+	*tau = ((int64_t)DT_S << Q_TH) / a1;
+	*ambient = RLS_T_REF + ((int64_t)theta[2] << FP_FRAC) / a1;
+}
+
+bool rls_gains(int32_t *kp, int32_t *ki)
+{
+	if (!rls_valid())
+		return false;
+
+	int32_t gain, tau, ambient;
+	rls_model(&gain, &tau, &ambient);
+	if (gain <= 0)
+		return false;
+
+	// IMC PI: kp = tau / (K * tau_cl), ti = tau, in PWM units
+	*kp = 255L * RLS_SPEEDUP * FP_SCALE * FP_SCALE / gain;
+	*ki = *kp * CYCLE_TIME / (1000L * tau);
+	return true;
+}
+
+void rls_print()
+{
+	int32_t gain, tau, ambient, kp, ki;
+
+	if (!rls_valid()) {
+		print_str_P(PSTR("model not valid\n"));
+		return;
+	}
+
+	rls_model(&gain, &tau, &ambient);
+	print_str_P(PSTR("model K "));
+	print_dec_fix(gain, FP_FRAC, 1);
+	print_str_P(PSTR(" C, tau "));
+	print_dec(tau);
+	print_str_P(PSTR(" s, ambient "));
+	print_dec_fix(ambient, FP_FRAC, 1);
+	print_str_P(PSTR(" C"));
+	if (rls_gains(&kp, &ki)) {
+		print_str_P(PSTR(", kp "));
+		print_dec_fix(kp, FP_FRAC, 2);
+		print_str_P(PSTR(" ki "));
+		print_dec_fix(ki, FP_FRAC, 2);
+	}
+	print_str_P(PSTR("\n"));
+}
@@ -0,0 +1,44 @@
+#ifndef RLS_H
+#define RLS_H
+#include <stdint.h>
+
+// Online identification of the box: recursive least squares fit of
+//   T[k+1] - T[k] = a1 * (T[k] - RLS_T_REF) + b * u[k] + c
+// from heater power u to air temperature T, on averages over RLS_DECIM
+// control cycles. The first order model follows from it:
+//   gain K = -b / a1, time constant tau = -dt / a1,
+//   ambient temperature = RLS_T_REF - c / a1
+
+// Control cycles per estimator step
+#define RLS_DECIM 16
+
+// Forgetting factor, memory of ~ 1 / (1 - lambda) steps
+#define RLS_LAMBDA 0.995
+
+// Initial covariance, also the upper limit of its trace / 3
+#define RLS_P0 10.0
+
+// Linearization point [degC]
+#define RLS_T_REF FP(25.0)
+
+// Closed loop time constant for the derived gains is tau / this
+#define RLS_SPEEDUP 4
+
+// Call this once per control cycle with the air temperature and the
+// applied heater power (both fixed point)
+void rls_update(int16_t temp, int16_t power);
+
+// true when the estimates are plausible
+bool rls_valid();
+
+// gain [degC per full heater power], tau [s], ambient [degC], fixed point
+void rls_model(int32_t *gain, int32_t *tau, int32_t *ambient);
+
+// PI gains for pid_air_step(), IMC tuning of the identified model
+// returns false if there is no valid model
+bool rls_gains(int32_t *kp, int32_t *ki);
+
+// Print the estimates
+void rls_print();
+
+#endif
@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include <string.h>
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include "sched.h"
+#include "print.h"
+
+static const struct task *tasks = NULL;
+static uint8_t n_tasks = 0;
+
+static struct {
+	uint32_t next;  // next release [ms]
+	uint32_t max_run;  // [us]
+	uint16_t max_jitter;  // release to start [ms]
+	uint16_t missed;  // deadline misses and skipped releases
+	uint32_t runs;  // a 2 ms task wraps it after 99 days
+} stats[SCHED_MAX_TASKS];
+
+// wrap-safe for the millis() overflow after 49 days
+static bool is_due(uint32_t ts_now, uint32_t ts)
+{
+	return (int32_t)(ts_now - ts) >= 0;
+}
+
+void sched_init(const struct task *t, uint8_t n, unsigned long ts_now)
+{
+	tasks = t;
+	n_tasks = n;
+
+	for (uint8_t i=0; i<n_tasks; i++) {
+		stats[i].next = ts_now + pgm_read_dword(&tasks[i].phase);
+		stats[i].max_run = 0;
+		stats[i].max_jitter = 0;
+		stats[i].missed = 0;
+		stats[i].runs = 0;
+	}
+}
+
+void sched_run(unsigned long ts_now)
+{
+	for (uint8_t i=0; i<n_tasks; i++) {
+		if (!is_due(ts_now, stats[i].next))
+			continue;
+
+		struct task t;
+		memcpy_P(&t, &tasks[i], sizeof(t));
+
+		uint32_t release = stats[i].next;
+		uint32_t jitter = ts_now - release;
+		uint32_t t_start = micros();
+
+		t.fn(ts_now);
+
+		uint32_t run = micros() - t_start;
+		if (run > stats[i].max_run)
+			stats[i].max_run = run;
+		if (jitter > stats[i].max_jitter)
+			stats[i].max_jitter = jitter > 0xFFFF ? 0xFFFF : jitter;
+		if (millis() - release > t.deadline)
+			stats[i].missed++;
+		stats[i].runs++;
+
+		// drift-free: relative to the release, not to ts_now
+		stats[i].next += t.period;
+
+		// more than a period behind, skip releases
+		while (is_due(ts_now, stats[i].next + t.period)) {
+			stats[i].next += t.period;
+			stats[i].missed++;
+		}
+
+		// only one task per call, let the caller poll in between
+		return;
+	}
+}
+
+void sched_dump()
+{
+	print_str_P(PSTR("task        runs  max_us  jit_ms  missed\n"));
+	for (uint8_t i=0; i<n_tasks; i++) {
+		struct task t;
+		memcpy_P(&t, &tasks[i], sizeof(t));
+
+		print_str(t.name);
+		for (uint8_t j=strlen(t.name); j<8; j++)
+			print_str_P(PSTR(" "));
+		print_udec_dp(stats[i].runs, 8, 0);
+		print_udec_dp(stats[i].max_run, 8, 0);
+		print_udec_dp(stats[i].max_jitter, 8, 0);
+		print_udec_dp(stats[i].missed, 8, 0);
+		print_str_P(PSTR("\n"));
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef SCHED_H
+#define SCHED_H
+#include <stdint.h>
+
+// Maximum number of entries in the task table
+#define SCHED_MAX_TASKS 8
+
+// A periodic task. Tasks run to completion, if several are due the one
+// closest to the start of the table runs first.
+struct task {
+	void (*fn)(unsigned long ts_now);
+	uint32_t period;  // [ms]
+	uint32_t phase;  // first release after sched_init() [ms]
+	uint16_t deadline;  // must be finished this long after release [ms]
+	char name[8];
+};
+
+// Call this once. `tasks` is a table in PROGMEM, n <= SCHED_MAX_TASKS
+void sched_init(const struct task *tasks, uint8_t n, unsigned long ts_now);
+
+// Run the highest priority task which is due. Call as often as possible
+void sched_run(unsigned long ts_now);
+
+// Print run time, jitter and deadline statistics of each task
+void sched_dump();
+
+#endif
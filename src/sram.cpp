@@ -0,0 +1,67 @@
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "sram.h"
+#include "uart_log.h"
+#include "print.h"
+
+#define PAINT 0xC5
+
+// from the linker script: end of .bss and top of the stack
+extern uint8_t _end;
+extern uint8_t __stack;
+
+static uint16_t free_min = 0xFFFF;
+
+// Runs right after reset, before .data and .bss are set up and before
+// anything is on the stack
+void sram_paint() __attribute__((naked, used, section(".init1")));
+
+void sram_paint()
+{
+	__asm volatile (
+		"	ldi r30, lo8(_end)\n"
+		"	ldi r31, hi8(_end)\n"
+		"	ldi r24, %0\n"
+		"	ldi r25, hi8(__stack)\n"
+		"	rjmp 2f\n"
+		"1:	st Z+, r24\n"
+		"2:	cpi r30, lo8(__stack)\n"
+		"	cpc r31, r25\n"
+		"	brlo 1b\n"
+		"	breq 1b\n"
+		:
+		: "i" (PAINT)
+		: "memory"
+	);
+}
+
+uint16_t sram_check()
+{
+	// up to the first byte the stack has written
+	const uint8_t *p = &_end;
+	while (p <= &__stack && *p == PAINT)
+		p++;
+
+	uint16_t n = p - &_end;
+	if (n < free_min) {
+		if (n < SRAM_MIN_FREE && free_min >= SRAM_MIN_FREE) {
+			log_prio(LOG_ERR);
+			print_str_P(PSTR("low stack headroom: "));
+			print_udec(n);
+			print_str_P(PSTR(" bytes\n"));
+			log_prio(LOG_INFO);
+		}
+		free_min = n;
+	}
+	return free_min;
+}
+
+void sram_print()
+{
+	print_str_P(PSTR("sram free "));
+	print_udec(SP - (uintptr_t)&_end);
+	print_str_P(PSTR(" bytes, min "));
+	print_udec(sram_check());
+	print_str_P(PSTR("\n"));
+}
@@ -0,0 +1,20 @@
+#ifndef SRAM_H
+#define SRAM_H
+#include <stdint.h>
+
+// Stack headroom monitor. Before main() the free SRAM between the end of
+// .bss and the top of the stack is painted with a fixed pattern. The
+// stack overwrites it as it grows, the paint left above .bss is the
+// minimum free SRAM so far. There is no heap, nothing calls malloc().
+
+// Log an error when the headroom drops below this [bytes]
+#define SRAM_MIN_FREE 64
+
+// Scan the paint, call this periodically. Returns the minimum free SRAM
+// since reset [bytes]
+uint16_t sram_check();
+
+// Print the free SRAM now and the minimum
+void sram_print();
+
+#endif
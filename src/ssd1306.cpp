@@ -6,6 +6,7 @@
 #include "ssd1306.h"
 #include "main.h"
 #include "print.h"
+#include "prof.h"
 
 #define I2C_ADDR 0x3C
 #define FB_SIZE DISPLAY_WIDTH * DISPLAY_HEIGHT / 8
@@ -18,6 +19,8 @@
 #define SET_COL_ADDR 0x21
 #define SET_PAGE_ADDR 0x22
 #define SET_DISP_START_LINE 0x40
+#define SET_SCROLL_OFF 0x2E
+#define CONTENT_SCROLL_LEFT 0x2D  // one column, towards column address 0
 #define SET_SEG_REMAP 0xA0
 #define SET_MUX_RATIO 0xA8
 #define SET_COM_OUT_DIR 0xC0
@@ -28,18 +31,77 @@
 #define SET_VCOM_DESEL 0xDB
 #define SET_CHARGE_PUMP 0x8D
 
-static const uint8_t send_dat[] PROGMEM = {
+#define N_PAGES (DISPLAY_HEIGHT / 8)
+
+#ifdef SSD_PAGE_MODE
+	// a single page, the picture loop renders and sends one page at a time
+	static uint8_t frameBuff[DISPLAY_WIDTH];
+	static uint8_t cur_page, last_page, cur_x0, cur_x1;
+
+	// first row and number of rows held in frameBuff
+	#define FB_Y0 (cur_page * 8u)
+	#define FB_ROWS 8
+#else
+	// framebuffer with 8 pixels / byte
+	static uint8_t frameBuff[FB_SIZE];
+
+	#define FB_Y0 0u
+	#define FB_ROWS DISPLAY_HEIGHT
+
+	// Modified column range [x0, x1] of each page, x0 > x1 if the page is clean
+	static_assert(N_PAGES == 8, "initialise dirty_x0 for all pages");
+	static uint8_t dirty_x0[N_PAGES] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+	static uint8_t dirty_x1[N_PAGES] = {0, 0, 0, 0, 0, 0, 0, 0};
+#endif
+
+uint8_t *g_frameBuff = frameBuff;
+
+// Number of bytes put on the bus for the last completed frame
+uint16_t ssd_bytes_sent = 0;
+static uint16_t frame_bytes = 0;
+
+// Address window of the region being sent
+static uint8_t win_dat[] = {
 	0x00,
 	SET_COL_ADDR, 0, DISPLAY_WIDTH - 1,
-	SET_PAGE_ADDR, 0, DISPLAY_HEIGHT / 8 - 1
+	SET_PAGE_ADDR, 0, N_PAGES - 1
 };
 
-// framebuffer with 8 pixels / byte
-// the first byte sets up the oled for a frambuffer write
-static uint8_t frameBuff[FB_SIZE + 1] = { 0x40 };
+static void send_done(unsigned char status);
 
-// actual framebuffer data starts here
-uint8_t *g_frameBuff = &frameBuff[1];
+// background transfer of a dirty region: set address window, then the data
+static struct i2c_xfer xf_win = {
+	I2C_ADDR << 1, I2C_XF_NOSTOP, 0, win_dat, sizeof(win_dat), NULL, 0
+};
+static struct i2c_xfer xf_dat = {
+	I2C_ADDR << 1, I2C_XF_PREFIX, 0x40, frameBuff, 0, send_done, 0
+};
+
+static bool send_failed = false;
+
+#ifdef SSD_PAGE_MODE
+	// every page is rendered from scratch, nothing to track
+	static void mark_dirty(uint8_t page, uint8_t x0, uint8_t x1) {}
+	static void mark_all_dirty() {}
+#else
+	// next page to check for dirty columns
+	static uint8_t send_page = N_PAGES;
+	static bool queue_next();
+
+	static void mark_dirty(uint8_t page, uint8_t x0, uint8_t x1)
+	{
+		if (x0 < dirty_x0[page])
+			dirty_x0[page] = x0;
+		if (x1 > dirty_x1[page])
+			dirty_x1[page] = x1;
+	}
+
+	static void mark_all_dirty()
+	{
+		for (uint8_t p=0; p<N_PAGES; p++)
+			mark_dirty(p, 0, DISPLAY_WIDTH - 1);
+	}
+#endif
 
 static const uint8_t init_dat[] PROGMEM = {
 	0x00,
@@ -80,7 +142,7 @@ static void cmd(uint8_t cmd)
 	uint8_t ret = i2c_start(I2C_ADDR << 1);
 	if (ret != 0) {
 		i2c_stop();
-		print_str("cmd failed\n");
+		print_str_P(PSTR("cmd failed\n"));
 		return;
 	}
 	i2c_write(0x80);
@@ -93,13 +155,16 @@ void ssd_init()
 	uint8_t ret = i2c_start(I2C_ADDR << 1);
 	if (ret != 0) {
 		i2c_stop();
-		print_str("ssd_init failed\n");
+		print_str_P(PSTR("ssd_init failed\n"));
 		return;
 	}
 	const uint8_t *p = init_dat;
 	for (uint8_t i=0; i<sizeof(init_dat); i++)
 		i2c_write(pgm_read_byte(p++));
 	i2c_stop();
+
+	// display RAM content is random after power-up
+	mark_all_dirty();
 }
 
 void ssd_poweroff()
@@ -141,39 +206,247 @@ void ssd_flip_y(bool val)
 		cmd(SET_COM_OUT_DIR | 0x08);
 }
 
-void ssd_send()
+// called from the TWI ISR when a region has been sent
+static void send_done(unsigned char status)
 {
-	uint8_t ret = i2c_start(I2C_ADDR << 1);
-	if (ret != 0) {
-		i2c_stop();
-		print_str("ssd_send0 failed\n");
+	if (status != 0) {
+		send_failed = true;
+#ifndef SSD_PAGE_MODE
+		send_page = N_PAGES;
+#endif
 		return;
 	}
-	const uint8_t *p = send_dat;
-	for (uint8_t i=0; i<sizeof(send_dat); i++)
-		i2c_write(pgm_read_byte(p++));
+#ifndef SSD_PAGE_MODE
+	queue_next();
+#endif
+}
 
-	ret = i2c_rep_start(I2C_ADDR << 1);
-	if (ret != 0) {
-		i2c_stop();
-		print_str("ssd_send1 failed\n");
-		return;
+static void check_failed()
+{
+	if (send_failed) {
+		print_str_P(PSTR("ssd_send failed\n"));
+		send_failed = false;
+		// display content is unknown now
+		mark_all_dirty();
 	}
+}
 
-	p = frameBuff;
-	for (uint16_t i=0; i<sizeof(frameBuff); i++)
-		i2c_write(*p++);
+#ifdef SSD_PAGE_MODE
 
-	i2c_stop();
+// queue the column range of the current page
+static void send_page_buf()
+{
+	win_dat[2] = cur_x0;
+	win_dat[3] = cur_x1;
+	win_dat[5] = cur_page;
+	win_dat[6] = cur_page;
+	xf_dat.buf = &frameBuff[cur_x0];
+	xf_dat.len = cur_x1 - cur_x0 + 1;
+
+	i2c_queue(&xf_win);
+	i2c_queue(&xf_dat);
+
+	// 2 address bytes + data prefix
+	frame_bytes += sizeof(win_dat) + xf_dat.len + 3;
+}
+
+void ssd_first_page(uint8_t p0, uint8_t p1, uint8_t x0, uint8_t x1)
+{
+	i2c_wait_idle();
+	check_failed();
+
+	ssd_bytes_sent = frame_bytes;
+	frame_bytes = 0;
+
+	cur_page = p0;
+	last_page = p1;
+	cur_x0 = x0;
+	cur_x1 = x1;
+	memset(frameBuff, 0, sizeof(frameBuff));
+}
+
+bool ssd_next_page()
+{
+	PROF_SCOPE(PROF_SSD);
+	send_page_buf();
+
+	// page buffer is re-used for the next page
+	i2c_wait_idle();
+
+	if (cur_page >= last_page)
+		return false;
+
+	cur_page++;
+	memset(frameBuff, 0, sizeof(frameBuff));
+	return true;
+}
+
+bool ssd_in_page(uint8_t y0, uint8_t y1)
+{
+	return (y0 >> 3) <= cur_page && (y1 >> 3) >= cur_page;
+}
+
+#else
+
+// Queue the next dirty region starting at send_page. Consecutive full
+// width pages are contiguous in the framebuffer and go out in one transfer.
+// Returns false if there is nothing left to send.
+static bool queue_next()
+{
+	uint8_t p0 = send_page;
+	while (p0 < N_PAGES && dirty_x0[p0] > dirty_x1[p0])
+		p0++;
+
+	if (p0 >= N_PAGES) {
+		send_page = N_PAGES;
+		return false;
+	}
+
+	uint8_t x0 = dirty_x0[p0], x1 = dirty_x1[p0], p1 = p0;
+	if (x0 == 0 && x1 == DISPLAY_WIDTH - 1)
+		while (p1 < N_PAGES - 1 &&
+		       dirty_x0[p1 + 1] == 0 &&
+		       dirty_x1[p1 + 1] == DISPLAY_WIDTH - 1)
+			p1++;
+
+	for (uint8_t p=p0; p<=p1; p++) {
+		dirty_x0[p] = 0xFF;
+		dirty_x1[p] = 0;
+	}
+	send_page = p1 + 1;
+
+	win_dat[2] = x0;
+	win_dat[3] = x1;
+	win_dat[5] = p0;
+	win_dat[6] = p1;
+	xf_dat.buf = &frameBuff[p0 * DISPLAY_WIDTH + x0];
+	xf_dat.len = (p1 - p0) * DISPLAY_WIDTH + x1 - x0 + 1;
+
+	i2c_queue(&xf_win);
+	i2c_queue(&xf_dat);
+
+	// 2 address bytes + data prefix
+	frame_bytes += sizeof(win_dat) + xf_dat.len + 3;
+	return true;
+}
+
+// Starts streaming the modified regions of the framebuffer to the display
+// and returns immediately. Call ssd_wait() before modifying the framebuffer.
+void ssd_send()
+{
+	PROF_SCOPE(PROF_SSD);
+	i2c_wait_idle();
+	check_failed();
+
+	ssd_bytes_sent = frame_bytes;
+	frame_bytes = 0;
+	send_page = 0;
+	queue_next();
+}
+
+// the whole framebuffer is in SRAM, dirty tracking takes care of the region
+void ssd_first_page(uint8_t p0, uint8_t p1, uint8_t x0, uint8_t x1)
+{
+	ssd_wait();
+}
+
+bool ssd_next_page()
+{
+	ssd_send();
+	return false;
+}
+
+bool ssd_in_page(uint8_t y0, uint8_t y1)
+{
+	return true;
+}
+
+#endif
+
+void ssd_wait()
+{
+	i2c_wait_idle();
+}
+
+// ----------------------
+//  Strip chart
+// ----------------------
+static uint8_t scr_p0, scr_p1, scr_x0, scr_x1;
+
+// column sent by ssd_put_column()
+static uint8_t col_dat[N_PAGES];
+
+void ssd_scroll_setup(uint8_t p0, uint8_t p1, uint8_t x0, uint8_t x1)
+{
+	scr_p0 = p0;
+	scr_p1 = p1;
+	scr_x0 = x0;
+	scr_x1 = x1;
+	ssd_wait();
+	cmd(SET_SCROLL_OFF);
+}
+
+void ssd_scroll_step()
+{
+	// the display needs 2 frames between content scrolls, the callers
+	// are much slower than that
+	ssd_wait();
+	cmd(CONTENT_SCROLL_LEFT);
+	cmd(0x00);
+	cmd(scr_p0);
+	cmd(0x01);
+	cmd(scr_p1);
+	cmd(scr_x0);
+	cmd(scr_x1);
+
+#ifndef SSD_PAGE_MODE
+	// same in the framebuffer, the display already shows it
+	for (uint8_t p=scr_p0; p<=scr_p1; p++) {
+		uint8_t *row = &frameBuff[p * DISPLAY_WIDTH];
+		uint8_t first = row[scr_x0];
+		memmove(&row[scr_x0], &row[scr_x0 + 1], scr_x1 - scr_x0);
+		row[scr_x1] = first;
+	}
+#endif
+}
+
+void ssd_put_column(uint8_t x, const uint8_t *bits)
+{
+	uint8_t n = scr_p1 - scr_p0 + 1;
+
+	i2c_wait_idle();
+	check_failed();
+
+	memcpy(col_dat, bits, n);
+#ifndef SSD_PAGE_MODE
+	for (uint8_t i=0; i<n; i++)
+		frameBuff[(scr_p0 + i) * DISPLAY_WIDTH + x] = bits[i];
+#endif
+
+	// a one column window, the bytes go down the pages
+	win_dat[2] = x;
+	win_dat[3] = x;
+	win_dat[5] = scr_p0;
+	win_dat[6] = scr_p1;
+	xf_dat.buf = col_dat;
+	xf_dat.len = n;
+
+	i2c_queue(&xf_win);
+	i2c_queue(&xf_dat);
+	frame_bytes += sizeof(win_dat) + n + 3;
 }
 
 // Set or clear a 1 bit pixel in framebuffer
 void setPixel(int16_t x, int16_t y, bool isSet)
 {
 	// screen clipping
-	if (x >= DISPLAY_WIDTH || y >= DISPLAY_HEIGHT || x < 0 || y < 0)
+	if (x >= DISPLAY_WIDTH || x < 0 || y < 0 ||
+	    (unsigned)y >= FB_Y0 + FB_ROWS || (unsigned)y < FB_Y0)
 		return;
 
+	mark_dirty(y >> 3, x, x);
+	y -= FB_Y0;
+
 	unsigned byte = x + DISPLAY_WIDTH * (y >> 3);
 	uint8_t mask = 1 << (y & 7);
 
@@ -183,6 +456,30 @@ void setPixel(int16_t x, int16_t y, bool isSet)
 		g_frameBuff[byte] &= ~mask;
 }
 
+// OR a byte into page `page` (absolute) of the framebuffer
+static void orByte(int16_t page, uint8_t x, uint8_t val)
+{
+	if (val == 0 || page < (int16_t)(FB_Y0 / 8) || page >= (int16_t)((FB_Y0 + FB_ROWS) / 8))
+		return;
+	mark_dirty(page, x, x);
+	g_frameBuff[(page - FB_Y0 / 8) * DISPLAY_WIDTH + x] |= val;
+}
+
+// OR 8 vertical pixels (LSB on top) into the framebuffer at x, y
+// If y is not aligned to a page, the column is split over 2 pages
+void orColumn(int16_t x, int16_t y, uint8_t bits)
+{
+	if (x < 0 || x >= DISPLAY_WIDTH || bits == 0)
+		return;
+
+	int16_t page = y >> 3;
+	uint8_t shift = y & 7;
+
+	orByte(page, x, bits << shift);
+	if (shift)
+		orByte(page + 1, x, bits >> (8 - shift));
+}
+
 static void limit(int *a, int *b, int lim)
 {
 	if (*a < 0)
@@ -203,8 +500,13 @@ static void limit(int *a, int *b, int lim)
 // get a 1 bit pixel-value from framebuffer
 bool getPixel(unsigned x, unsigned y)
 {
-	if (x >= DISPLAY_WIDTH || y >= DISPLAY_HEIGHT)
+	if (x >= DISPLAY_WIDTH || y >= FB_Y0 + FB_ROWS)
+		return false;
+#ifdef SSD_PAGE_MODE
+	if (y < FB_Y0)
 		return false;
+#endif
+	y -= FB_Y0;
 	unsigned byte = x + DISPLAY_WIDTH * (y >> 3);
 	uint8_t mask = 1 << (y & 7);
 	return g_frameBuff[byte] & mask;
@@ -214,12 +516,28 @@ bool getPixel(unsigned x, unsigned y)
 void fill(bool val)
 {
 	uint8_t tmp = val ? 0xFF : 0x00;
-	memset(g_frameBuff, tmp, FB_SIZE);
+	uint8_t *pBuf = g_frameBuff;
+
+	// only mark the bytes which actually change
+	for (uint8_t p=0; p<FB_ROWS / 8; p++) {
+		for (uint8_t x=0; x<DISPLAY_WIDTH; x++, pBuf++) {
+			if (*pBuf != tmp) {
+				*pBuf = tmp;
+				mark_dirty(p, x, x);
+			}
+		}
+	}
 }
 
-// no checks! Too bad.
+// no checks on x! Too bad.
 void hLine(unsigned x, unsigned y, unsigned w, bool isSet)
 {
+	if (w == 0 || y >= FB_Y0 + FB_ROWS) return;
+#ifdef SSD_PAGE_MODE
+	if (y < FB_Y0) return;
+#endif
+	mark_dirty(y / 8, x, x + w - 1);
+	y -= FB_Y0;
 	uint8_t *pBuf = &g_frameBuff[(y / 8) * DISPLAY_WIDTH + x];
 	uint8_t mask = 1 << (y & 7);
 	if (isSet){
@@ -232,10 +550,27 @@ void hLine(unsigned x, unsigned y, unsigned w, bool isSet)
 	}
 }
 
-// no checks!
+// no checks on x!
 void vLine(unsigned x, unsigned y, unsigned h, bool isSet)
 {
+	// clip to the rows held in the buffer
+#ifdef SSD_PAGE_MODE
+	if (y < FB_Y0) {
+		if (y + h <= FB_Y0) return;
+		h -= FB_Y0 - y;
+		y = FB_Y0;
+	}
+#endif
+	if (y + h > FB_Y0 + FB_ROWS) {
+		if (y >= FB_Y0 + FB_ROWS) return;
+		h = FB_Y0 + FB_ROWS - y;
+	}
 	if (h <= 0) return;
+
+	for (unsigned p=y / 8; p<=(y + h - 1) / 8; p++)
+		mark_dirty(p, x, x);
+
+	y -= FB_Y0;
 	uint8_t *pBuf = &g_frameBuff[(y / 8) * DISPLAY_WIDTH + x];
 
 	// do the first partial byte, if necessary - this requires some masking
@@ -292,6 +627,11 @@ void fillRect(int x0, int x1, int y0, int y1, bool isSet)
 {
 	limit(&x0, &x1, DISPLAY_WIDTH - 1);
 	limit(&y0, &y1, DISPLAY_HEIGHT - 1);
+	// only the rows held in the buffer
+	if (y0 < (int)FB_Y0)
+		y0 = FB_Y0;
+	if (y1 > (int)(FB_Y0 + FB_ROWS - 1))
+		y1 = FB_Y0 + FB_ROWS - 1;
 	int w = x1 - x0 + 1;
 	for (int y=y0; y<=y1; y++)
 		hLine(x0, y, w, isSet);
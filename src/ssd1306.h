@@ -8,6 +8,13 @@
 #define DISPLAY_HEIGHT  64
 #define LV_BPP 1  // bits / pixel
 
+// Render page by page into a 128 byte buffer instead of keeping a
+// 1 kB framebuffer in SRAM: 909 B less static data, 352 B of them give the
+// history 48 h. gui() then waits for the bus after every page, a full
+// redraw blocks for ~22 ms at 400 kHz. Measure the stack and the loop time
+// on the target before enabling it.
+// #define SSD_PAGE_MODE
+
 void ssd_init();
 void ssd_poweroff();
 void ssd_poweron();
@@ -15,12 +22,42 @@ void ssd_contrast(uint8_t val);
 void ssd_invert();  // swap on and off
 void ssd_flip_x(bool val);  // swap left and right
 void ssd_flip_y(bool val);  // swap up and down
-void ssd_send();
+#ifndef SSD_PAGE_MODE
+void ssd_send();  // non-blocking
+#endif
+void ssd_wait();  // wait until framebuffer is sent
+
+// Picture loop, works in both modes. Pages p0 .. p1, columns x0 .. x1
+// are re-rendered in page mode:
+//   ssd_first_page(p0, p1, x0, x1);
+//   do {
+//       draw everything which overlaps ssd_in_page()
+//   } while (ssd_next_page());
+void ssd_first_page(uint8_t p0, uint8_t p1, uint8_t x0, uint8_t x1);
+bool ssd_next_page();
+// true if some of the rows y0 .. y1 are in the page being rendered
+bool ssd_in_page(uint8_t y0, uint8_t y1);
+
+// Strip chart in pages p0 .. p1, columns x0 .. x1, moved by the display's
+// content scroll. A new sample only costs one column on the bus:
+//   ssd_scroll_setup(p0, p1, x0, x1);
+//   ssd_scroll_step();  // one column towards x0
+//   ssd_put_column(x1, bits);  // bits[0] is page p0, LSB on top
+// The framebuffer follows along, drawing over the region is up to the caller.
+void ssd_scroll_setup(uint8_t p0, uint8_t p1, uint8_t x0, uint8_t x1);
+void ssd_scroll_step();
+void ssd_put_column(uint8_t x, const uint8_t *bits);
+
+// Number of bytes put on the bus for the last completed frame
+extern uint16_t ssd_bytes_sent;
 
 // SET / GET a single pixel in the framebuffer
 void setPixel(int16_t x, int16_t y, bool isSet);
 bool getPixel(unsigned x, unsigned y);
 
+// OR 8 vertical pixels (LSB on top) into the framebuffer at x, y
+void orColumn(int16_t x, int16_t y, uint8_t bits);
+
 // Set whole screen to fixed value
 void fill(bool val);
 void fillRect(int x0, int x1, int y0, int y1, bool isSet);
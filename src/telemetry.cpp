@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "telemetry.h"
+#include "uart_log.h"
+#include "print.h"
+#include "pid.h"
+#include "hatch.h"
+#include "temp_sensor.h"
+#include "main.h"
+
+bool telemetry_binary = false;
+
+static void print_text(struct telemetry *t)
+{
+	print_str_P(PSTR("a "));
+	print_dec_fix(t->air, FP_FRAC, 2);
+	print_str_P(PSTR(" / "));
+	print_dec_fix(t->air_set, FP_FRAC, 2);
+	print_str_P(PSTR(", "));
+
+	print_str_P(PSTR("p "));
+	print_dec_fix(t->probe, FP_FRAC, 2);
+	print_str_P(PSTR(" / "));
+	print_dec_fix(t->probe_set, FP_FRAC, 2);
+	print_str_P(PSTR(", "));
+
+	if (t->flags & TM_DUAL) {
+		print_str_P(PSTR("pi "));
+		print_dec_fix(t->probe_i / 8, FP_FRAC, 2);
+		print_str_P(PSTR(", "));
+
+		print_str_P(PSTR("pp "));
+		print_dec_fix(t->probe_p, FP_FRAC, 2);
+		print_str_P(PSTR(", "));
+	}
+
+	print_str_P(PSTR("ai "));
+	print_dec_fix(t->air_i, FP_FRAC, 2);
+	print_str_P(PSTR(", "));
+
+	print_str_P(PSTR("ap "));
+	print_dec_fix(t->air_p, FP_FRAC, 2);
+	print_str_P(PSTR(", "));
+
+	print_str_P(PSTR("h "));
+	if (t->flags & TM_HEATER_ENABLED)
+		print_dec_fix(t->heater, FP_FRAC, 2);
+	else
+		print_str_P(PSTR("off"));
+	print_str_P(PSTR("\n"));
+}
+
+// COBS encoded, with a 0x00 delimiter on both sides so frames
+// re-synchronize after interleaved text output
+static void send_cobs(const uint8_t *p, uint8_t len)
+{
+	const uint8_t *end = p + len;
+
+	log_putc(0);
+	while (true) {
+		const uint8_t *run = p;
+		while (p < end && *p != 0 && p - run < 254)
+			p++;
+
+		uint8_t n = p - run;
+		log_putc(n + 1);
+		while (run < p)
+			log_putc(*run++);
+
+		if (p >= end)
+			break;
+
+		// skip the zero, it is encoded in the code byte
+		if (n < 254)
+			p++;
+	}
+	log_putc(0);
+}
+
+void telemetry_send(struct telemetry *t)
+{
+	t->version = TELEMETRY_VERSION;
+	t->flags = (heater_enabled ? TM_HEATER_ENABLED : 0) |
+	           (n_sensors >= 2 ? TM_DUAL : 0);
+	t->one_wire_error = one_wire_error;
+	t->hatch = hatch_pos();
+	t->uptime = ms_since_start;
+
+	if (!telemetry_binary) {
+		print_text(t);
+		return;
+	}
+
+	uint8_t buf[sizeof(struct telemetry) + 2];
+	uint16_t crc = tm_crc16((const uint8_t *)t, sizeof(*t));
+	memcpy(buf, t, sizeof(*t));
+	buf[sizeof(*t)] = crc & 0xFF;
+	buf[sizeof(*t) + 1] = crc >> 8;
+	send_cobs(buf, sizeof(buf));
+}
@@ -0,0 +1,53 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+#include <stdint.h>
+
+// Per-cycle log of the control loop. Sent either as the human readable
+// text line or as a COBS framed binary struct with CRC16, see
+// tools/telemetry_decode.cpp for the host side.
+// This header is shared with the host tools, keep it free of AVR stuff.
+
+#define TELEMETRY_VERSION 1
+
+// flags
+#define TM_HEATER_ENABLED (1 << 0)
+#define TM_DUAL (1 << 1)  // two sensors
+
+// little endian, as on the AVR
+struct __attribute__((packed)) telemetry {
+	uint8_t version;
+	uint8_t flags;
+	uint8_t one_wire_error;
+	uint8_t hatch;  // [steps]
+	uint32_t uptime;  // ms_since_start [ms]
+	// all fixed point values with FP_FRAC fractional bits
+	int16_t air;  // [degC]
+	int16_t air_set;
+	int16_t probe;
+	int16_t probe_set;
+	int16_t heater;  // [PWM units]
+	int32_t air_p;
+	int32_t air_i;
+	int32_t probe_p;  // [degC]
+	int32_t probe_i;  // scaled by 8
+};
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+static inline uint16_t tm_crc16(const uint8_t *p, uint8_t len)
+{
+	uint16_t crc = 0xFFFF;
+	while (len--) {
+		crc ^= (uint16_t)(*p++) << 8;
+		for (uint8_t i=0; i<8; i++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+// true: send binary frames instead of the text line
+extern bool telemetry_binary;
+
+// Fill in the common fields and send the cycle log
+void telemetry_send(struct telemetry *t);
+
+#endif
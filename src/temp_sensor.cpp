@@ -3,14 +3,35 @@
 #include "print.h"
 #include "main.h"
 #include "temp_sensor.h"
+#include "ow_timer.h"
+#include "crc.h"
+#include "prof.h"
 
 // a 4.7K resistor is necessary
+// The library is only used for searching and configuring the sensors,
+// the periodic readings go through the timer driven ow_timer.
 OneWire ds(PIN_ONE_WIRE);
 
 uint8_t n_sensors = 0;
 uint8_t one_wire_error = 0;
-uint8_t ds_addr_air[8];
-uint8_t ds_addr_probe[8];
+static bool retry = false;
+
+// MATCH ROM, 8 byte address, READ SCRATCHPAD
+static uint8_t cmd_air[10] = {0x55, 0, 0, 0, 0, 0, 0, 0, 0, 0xBE};
+static uint8_t cmd_probe[10] = {0x55, 0, 0, 0, 0, 0, 0, 0, 0, 0xBE};
+static uint8_t * const ds_addr_air = &cmd_air[1];
+static uint8_t * const ds_addr_probe = &cmd_probe[1];
+
+// SKIP ROM (address all sensors), CONVERT T
+static const uint8_t cmd_conv[2] = {0xCC, 0x44};
+
+static uint8_t data_air[9];
+static uint8_t data_probe[9];
+
+static struct ow_xfer xf_air = {cmd_air, sizeof(cmd_air), data_air, 9, 0, OW_BUSY};
+static struct ow_xfer xf_probe = {cmd_probe, sizeof(cmd_probe), data_probe, 9, 0, OW_BUSY};
+// with parasite power on at the end
+static struct ow_xfer xf_conv = {cmd_conv, sizeof(cmd_conv), NULL, 0, OW_POWER, OW_BUSY};
 
 // returns 0 on success
 static uint8_t init_sensor(uint8_t *ds_addr)
@@ -20,20 +41,20 @@ static uint8_t init_sensor(uint8_t *ds_addr)
 	}
 	hexDump(ds_addr, 8);
 
-	if (OneWire::crc8(ds_addr, 7) != ds_addr[7]) {
+	if (crc8(ds_addr, 7) != ds_addr[7]) {
 		return 3;
 	}
 
 	// the first ROM byte is the chip-id
 	switch (ds_addr[0]) {
 		case 0x10:
-			print_str(" DS18S20\n");  // or old DS1820
+			print_str_P(PSTR(" DS18S20\n"));  // or old DS1820
 			break;
 		case 0x28:
-			print_str(" DS18B20\n");
+			print_str_P(PSTR(" DS18B20\n"));
 			break;
 		case 0x22:
-			print_str(" DS1822\n");
+			print_str_P(PSTR(" DS1822\n"));
 			break;
 		default:
 			return 4;
@@ -61,15 +82,19 @@ uint8_t init_one_wire(void)
 {
 	uint8_t ret = 0;
 
+	// the bus is shared with the transaction engine
+	while (ow_busy());
+	ow_init();
+
 	n_sensors = 0;
 
 	ds.reset_search();
 	while (ds.search(ds_addr_air))
 		n_sensors++;
 
-	print_str("Number of 1-wire sensors found: ");
+	print_str_P(PSTR("Number of 1-wire sensors found: "));
 	print_dec(n_sensors);
-	print_str("\n");
+	print_str_P(PSTR("\n"));
 
 	if (n_sensors <= 0) {
 		return 99;
@@ -96,47 +121,74 @@ uint8_t init_one_wire(void)
 	return ret;
 }
 
-// start conversion, with parasite power on at the end, return 0 on success
-uint8_t conv_temp()
+void temp_request()
 {
-	if (!ds.reset()) {
-		one_wire_error = 6;
-		return one_wire_error;
-	}
-
-	ds.skip();			// address all sensors on the bus
-	ds.write(0x44, 1);  // Start conversion, now wait
-	one_wire_error = 0;
-	return 0;
+	// the last request is still running, it is collected next cycle
+	if (ow_busy())
+		return;
+
+	ow_queue(&xf_air);
+	if (n_sensors >= 2)
+		ow_queue(&xf_probe);
+	ow_queue(&xf_conv);
 }
 
 // return 0 on success
-uint8_t read_temp(uint8_t *ds_addr, int16_t *val)
+static uint8_t get_temp(struct ow_xfer *x, ds_temp *val)
 {
-	uint8_t data[9];
+	if (x->status == OW_NO_PRESENCE)
+		return 7;
 
-	if (!ds.reset()) {
-		one_wire_error = 7;
-		return one_wire_error;
-	}
+	if (x->status == OW_LATE)
+		return 10;  // try again in the next cycle
 
-	ds.select(ds_addr);
-	ds.write(0xBE);  // Read Scratchpad
-	ds.read_bytes(data, 9);
+	if (x->status != OW_OK)
+		return 9;  // not done yet
 
-	uint8_t crc = OneWire::crc8(data, 8);
-	if (data[8] != crc) {
-		hexDump(data, 9);
-		print_str("One-wire CRC Error. Expected: ");
+	uint8_t crc = crc8(x->rx, 8);
+	if (x->rx[8] != crc) {
+		hexDump(x->rx, 9);
+		print_str_P(PSTR("One-wire CRC Error. Expected: "));
 		print_hex(crc, 2);
-		print_str("\n");
-		one_wire_error = 8;
-		return one_wire_error;
+		print_str_P(PSTR("\n"));
+		return 8;
 	}
 
 	if (val != NULL)
-		*val = (data[1] << 8) | data[0];
+		*val = ds_temp::from_raw((x->rx[1] << 8) | x->rx[0]);
+
+	return 0;
+}
+
+// no error, or one which the next cycle retries
+static bool late(uint8_t e)
+{
+	return e == 0 || e == 9 || e == 10;
+}
+
+bool temp_retry()
+{
+	return retry;
+}
+
+// return 0 on success
+uint8_t temp_collect(ds_temp *air, ds_temp *probe)
+{
+	PROF_SCOPE(PROF_TEMP);
+	uint8_t e_air = get_temp(&xf_air, air);
+	uint8_t e_probe = 0;
+	uint8_t e_conv = 0;
+
+	if (n_sensors >= 2)
+		e_probe = get_temp(&xf_probe, probe);
+
+	if (xf_conv.status == OW_NO_PRESENCE)
+		e_conv = 6;
+	else if (xf_conv.status != OW_OK)
+		e_conv = 9;
+
+	one_wire_error = e_air ? e_air : e_probe ? e_probe : e_conv;
+	retry = late(e_air) && late(e_probe) && late(e_conv);
 
-	one_wire_error = 0;
-	return one_wire_error;
+	return e_air | (e_probe << 4) | e_conv;
 }
@@ -1,21 +1,32 @@
 #ifndef TEMP_SENSOR_H
 #define TEMP_SENSOR_H
 #include <stdint.h>
+#include "fixed.h"
 
 #define SWAP_SENSORS
 
 extern uint8_t n_sensors;
 extern uint8_t one_wire_error;
-extern uint8_t ds_addr_air[8];
-extern uint8_t ds_addr_probe[8];
+
+// DS18B20 reading [degC]
+typedef fixed<int16_t, 4> ds_temp;
 
 uint8_t init_one_wire(void);
 
-// start conversion, wait before calling read_temp()
-uint8_t conv_temp();
+// Queue reading the scratchpads and starting the next conversion.
+// Returns immediately, the transactions run in the background.
+void temp_request();
 
-// writes temperature in [degC] as signed fixed point number with nFract = 4
+// Collect the readings of the last temp_request(), which must have been
+// at least one conversion time (750 ms) after the previous one.
 // returns 0 on success
-uint8_t read_temp(uint8_t *ds_addr, int16_t *val);
+uint8_t temp_collect(ds_temp *air, ds_temp *probe);
+
+// true if the failures of the last temp_collect() were only late or
+// unfinished transactions, the next temp_request() retries them
+bool temp_retry();
+
+// Cycles in a row with such failures until the sensors are re-initialised
+#define TEMP_N_MISS 5
 
 #endif
@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include <Arduino.h>
+#include "uart_log.h"
+#include "print.h"
+
+#define LOG_MASK (LOG_BUF_SIZE - 1)
+
+static char buf[LOG_BUF_SIZE];
+static uint8_t head = 0, tail = 0;
+static uint8_t prio = LOG_INFO;
+// nesting depth of log_blocking(true), setup() starts blocking
+static uint8_t blocking = 1;
+// dropped since the last marker in the output
+static uint16_t n_lost = 0;
+
+static const char lost_str[] PROGMEM = " bytes lost]\n";
+
+uint16_t log_dropped[LOG_N_PRIOS];
+
+static uint8_t fill()
+{
+	return (head - tail) & LOG_MASK;
+}
+
+static void drop(uint8_t p)
+{
+	if (log_dropped[p] < 0xFFFF)
+		log_dropped[p]++;
+	if (n_lost < 0xFFFF)
+		n_lost++;
+}
+
+static void put(char c)
+{
+	buf[head] = c;
+	head = (head + 1) & LOG_MASK;
+}
+
+// "\n[n bytes lost]\n", as soon as it fits
+static void put_lost()
+{
+	char digits[6];
+	uint8_t n = udec16(n_lost, 1, digits);
+
+	if (fill() + 2 + n + sizeof(lost_str) >= LOG_BUF_SIZE - 1)
+		return;
+	put('\n');
+	put('[');
+	for (uint8_t i=0; i<n; i++)
+		put(digits[i]);
+	for (const char *p=lost_str; pgm_read_byte(p); p++)
+		put(pgm_read_byte(p));
+	n_lost = 0;
+}
+
+void log_putc(char c)
+{
+	// Serial.write() waits for the UART
+	if (blocking)
+		while (fill() >= LOG_BUF_SIZE - 1) {
+			Serial.write(buf[tail]);
+			tail = (tail + 1) & LOG_MASK;
+		}
+
+	if (n_lost)
+		put_lost();
+
+	if (prio == LOG_DEBUG && fill() >= LOG_BUF_SIZE / 2) {
+		drop(prio);
+		return;
+	}
+
+	if (fill() >= LOG_BUF_SIZE - 1) {
+		if (prio != LOG_ERR && LOG_POLICY == LOG_DROP_NEWEST) {
+			drop(prio);
+			return;
+		}
+		// make room
+		tail = (tail + 1) & LOG_MASK;
+		drop(prio);
+	}
+
+	put(c);
+}
+
+void log_prio(uint8_t p)
+{
+	prio = p;
+}
+
+void log_flush()
+{
+	while (tail != head && Serial.availableForWrite() > 0) {
+		Serial.write(buf[tail]);
+		tail = (tail + 1) & LOG_MASK;
+	}
+}
+
+void log_blocking(bool val)
+{
+	if (val)
+		blocking++;
+	else if (blocking)
+		blocking--;
+}
@@ -0,0 +1,45 @@
+#ifndef UART_LOG_H
+#define UART_LOG_H
+#include <stdint.h>
+
+// Ring buffer between print.h and the UART. Writing to it never blocks
+// once setup() has called log_blocking(false), bytes which don't fit are
+// dropped according to LOG_POLICY and counted in log_dropped[]. The next
+// byte which fits is preceded by "[n bytes lost]" on a line of its own.
+
+// Size of the log buffer [bytes], power of 2, max. 256
+#define LOG_BUF_SIZE 128
+
+// What happens to a byte if the buffer is full
+#define LOG_DROP_NEWEST 0
+#define LOG_DROP_OLDEST 1
+#define LOG_POLICY LOG_DROP_NEWEST
+
+// Priority of the output.
+// LOG_ERR always makes room by dropping the oldest bytes,
+// LOG_DEBUG only goes in while the buffer is less than half full.
+enum LOG_PRIOS {
+	LOG_ERR,
+	LOG_INFO,
+	LOG_DEBUG,
+	LOG_N_PRIOS
+};
+
+// number of dropped bytes per priority
+extern uint16_t log_dropped[LOG_N_PRIOS];
+
+// Put a character into the log buffer
+void log_putc(char c);
+
+// Set the priority of the following output, default is LOG_INFO
+void log_prio(uint8_t p);
+
+// Move as many bytes to the UART as fit without blocking.
+// Call this periodically
+void log_flush();
+
+// Wait for the UART instead of dropping, for setup() and the output of
+// the serial commands. Calls nest, each true needs a false
+void log_blocking(bool val);
+
+#endif
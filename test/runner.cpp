@@ -0,0 +1,83 @@
+// usage: ./program [-b] [name]
+//   runs the tests whose name contains `name`, all by default
+//   -b  runs the benchmarks as well
+#include <string.h>
+#include <time.h>
+#include "runner.h"
+
+static runner_case *first = NULL, **last = &first;
+static unsigned n_failed;
+
+runner_reg::runner_reg(runner_case *c)
+{
+	*last = c;
+	last = &c->next;
+}
+
+void runner_fail(const char *file, int line, const char *expr)
+{
+	printf("  %s:%d: CHECK(%s) failed\n", file, line, expr);
+	n_failed++;
+}
+
+void runner_fail_eq(const char *file, int line, const char *expr,
+	long long a, long long b)
+{
+	printf("  %s:%d: CHECK_EQ(%s) failed: %lld != %lld\n",
+		file, line, expr, a, b);
+	n_failed++;
+}
+
+static double now_s()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// doubles n until the run takes 0.2 s, reports the time per iteration
+static void bench(runner_case *c)
+{
+	for (uint32_t n=1; ; n *= 2) {
+		double t0 = now_s();
+		c->bench(n);
+		double dt = now_s() - t0;
+		if (dt >= 0.2 || n >= 1UL << 30) {
+			printf("%-24s %10.1f ns  (n = %lu)\n", c->name,
+				dt * 1e9 / n, (unsigned long)n);
+			return;
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	bool benchmarks = false;
+	const char *filter = "";
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "-b") == 0)
+			benchmarks = true;
+		else
+			filter = argv[i];
+	}
+
+	unsigned n_tests = 0, n_bad = 0;
+	for (runner_case *c=first; c; c=c->next) {
+		if (!strstr(c->name, filter))
+			continue;
+		if (c->test) {
+			unsigned before = n_failed;
+			c->test();
+			n_tests++;
+			if (n_failed != before) {
+				printf("FAIL %s\n", c->name);
+				n_bad++;
+			}
+		} else if (benchmarks) {
+			bench(c);
+		}
+	}
+
+	printf("%u tests, %u failed\n", n_tests, n_bad);
+	return n_bad ? 1 : 0;
+}
@@ -0,0 +1,63 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+#include <stdint.h>
+#include <stdio.h>
+
+// Unit tests and micro-benchmarks of the firmware on the host, linked with
+// the native HAL (env:test). Each test_*.cpp registers its cases:
+//   TEST(crc8_rom) {
+//       CHECK_EQ(crc8(rom, 7), rom[7]);
+//   }
+//   BENCH(crc8, n) {
+//       for (uint32_t i=0; i<n; i++)
+//           bench_keep(crc8(rom, 7));
+//   }
+// A failed CHECK reports the line and the test goes on. Benchmarks only
+// run with -b, n is raised until a run takes long enough to be timed.
+
+struct runner_case {
+	const char *name;
+	void (*test)();
+	void (*bench)(uint32_t n);
+	runner_case *next;
+};
+
+// adds the case to the list, in the order of definition
+struct runner_reg {
+	runner_reg(runner_case *c);
+};
+
+void runner_fail(const char *file, int line, const char *expr);
+void runner_fail_eq(const char *file, int line, const char *expr,
+	long long a, long long b);
+
+#define TEST(name) \
+	static void test_##name(); \
+	static runner_case case_##name = {#name, test_##name, NULL, NULL}; \
+	static runner_reg reg_##name(&case_##name); \
+	static void test_##name()
+
+#define BENCH(name, n) \
+	static void bench_##name(uint32_t n); \
+	static runner_case case_##name = {#name, NULL, bench_##name, NULL}; \
+	static runner_reg reg_##name(&case_##name); \
+	static void bench_##name(uint32_t n)
+
+#define CHECK(c) do { \
+	if (!(c)) \
+		runner_fail(__FILE__, __LINE__, #c); \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+	long long a_ = (a), b_ = (b); \
+	if (a_ != b_) \
+		runner_fail_eq(__FILE__, __LINE__, #a " == " #b, a_, b_); \
+} while (0)
+
+// keeps the compiler from optimizing the benchmarked code away
+#define bench_keep(x) do { \
+	__typeof__(x) k_ = (x); \
+	__asm__ volatile("" : : "g"(k_) : "memory"); \
+} while (0)
+
+#endif
@@ -0,0 +1,122 @@
+// Relay feedback experiment on first order plants with dead time: the
+// identified ultimate gain and period against the analytic ones, and a
+// step response of the PI loop with the resulting gains
+#include <string.h>
+#include <math.h>
+#include "hal.h"
+#include "autotune.h"
+#include "ee_store.h"
+#include "gfx.h"
+#include "pid.h"
+#include "runner.h"
+
+#define K (15.0 / 255)  // [degC per PWM unit]
+#define T_AMB (30.0 - K * 129.5)  // [degC], 30 degC at half power
+#define DT 1.0  // one control cycle [s]
+
+// ultimate frequency: atan(w * tau) + w * L = pi
+static double omega_u(double tau, double l)
+{
+	double lo = 0, hi = M_PI / l;
+	for (int i=0; i<60; i++) {
+		double w = (lo + hi) / 2;
+		if (atan(w * tau) + w * l < M_PI)
+			lo = w;
+		else
+			hi = w;
+	}
+	return lo;
+}
+
+// plant state: temperature, heater power on its way to the box
+struct plant {
+	double tau;
+	int delay;  // [cycles]
+	double t;  // [degC]
+	double u[64];  // [PWM units]
+};
+
+static void plant_step(struct plant *pl, double power)
+{
+	// the heat arrives `delay` cycles later
+	memmove(pl->u + 1, pl->u, sizeof(pl->u) - sizeof(pl->u[0]));
+	pl->u[0] = power;
+	pl->t += DT / pl->tau * (T_AMB + K * pl->u[pl->delay] - pl->t);
+}
+
+// runs the experiment, returns the kp / ki it stored
+static bool identify(struct plant *pl, int32_t *kp, int32_t *ki)
+{
+	target_air_temperature = fp16::from(30);
+	autotune_start();
+	for (int k=0; k<AT_TIMEOUT && autotune_active(); k++)
+		plant_step(pl, (double)autotune_step(FP(pl->t)) / FP_SCALE);
+	return load_ee(kp, SL_AIR_KP) && load_ee(ki, SL_AIR_KI);
+}
+
+// PI loop with the gains from a 2 degC step, returns the overshoot and the
+// error after n cycles [degC]
+static void step_response(struct plant *pl, double kp, double ki, int n,
+	double *overshoot, double *err)
+{
+	double set = pl->t + 2, i = 0, t_max = 0;
+	for (int k=0; k<n; k++) {
+		double e = set - pl->t;
+		double u = kp * e + i;
+		// the integrator stops at the limits
+		if (u > 255)
+			u = 255;
+		else if (u < 4)
+			u = 4;
+		else
+			i += ki * e * DT;
+		plant_step(pl, u);
+		if (pl->t > t_max)
+			t_max = pl->t;
+	}
+	*overshoot = t_max - set;
+	*err = fabs(set - pl->t);
+}
+
+TEST(autotune_fopdt)
+{
+	uint8_t saved[sizeof(hal_eeprom)];
+	memcpy(saved, hal_eeprom, sizeof(saved));
+	uint8_t mux = print_mux;
+	print_mux = 0;
+
+	const struct {
+		double tau;
+		int delay;
+	} plants[] = {{300, 20}, {600, 10}, {900, 40}};
+
+	for (auto &p : plants) {
+		struct plant pl = {p.tau, p.delay, 30.0, {0}};
+		int32_t kp = 0, ki = 0;
+		CHECK(identify(&pl, &kp, &ki));
+		CHECK(!autotune_active());
+
+		// the sample and hold adds half a cycle to the dead time
+		double w = omega_u(p.tau, p.delay + DT / 2);
+		double ku = sqrt(1 + w * w * p.tau * p.tau) / K;
+		double tu = 2 * M_PI / w;
+
+		// kp = 0.45 ku, ki = 0.54 ku / tu
+		double ku_id = kp / 0.45 / FP_SCALE;
+		double tu_id = 0.54 * ku_id / (ki / (double)FP_SCALE);
+		double os, err;
+		step_response(&pl, kp / (double)FP_SCALE, ki / (double)FP_SCALE, 20 * tu, &os, &err);
+		// the relay oscillates above -180 deg of phase: ku comes out low and
+		// tu long, the gains err on the safe side
+		CHECK(ku_id < ku && ku_id > 0.35 * ku);
+		CHECK(tu_id > tu && tu_id < 3 * tu);
+		// and they control the plant
+		CHECK(os < 0.1);
+		CHECK(err < 0.01);
+	}
+
+	memcpy(hal_eeprom, saved, sizeof(saved));
+	ee_init();
+	pid_init();
+	print_mux = mux;
+}
@@ -0,0 +1,135 @@
+// Log structured EEPROM store, with power losses
+#include <string.h>
+#include "ee_store.h"
+#include "gfx.h"
+#include "hal.h"
+#include "runner.h"
+
+static uint8_t saved[E2END + 1];
+static uint8_t saved_mux;
+
+// other tests share the EEPROM, and the store prints every write
+static void begin()
+{
+	memcpy(saved, hal_eeprom, sizeof(saved));
+	saved_mux = print_mux;
+	print_mux = 0;
+	memset(hal_eeprom, 0xFF, sizeof(hal_eeprom));
+	ee_init();
+}
+
+static void end()
+{
+	memcpy(hal_eeprom, saved, sizeof(saved));
+	ee_init();
+	print_mux = saved_mux;
+}
+
+static int32_t load(uint8_t key)
+{
+	int32_t v = -1;
+	CHECK(load_ee(&v, key));
+	return v;
+}
+
+// Cuts the power at every byte write of one store, reboots and checks
+// that the key has the old or the new value and the others are intact.
+// The next store after the reboot must work.
+static void power_loss(int32_t val, uint8_t key)
+{
+	static uint8_t base[E2END + 1];
+	static const uint8_t torn[] = {0x00, 0xFF, 0x5A};
+	int32_t vals[EE_N_KEYS];
+
+	memcpy(base, hal_eeprom, sizeof(base));
+	for (uint8_t k=0; k<EE_N_KEYS; k++)
+		vals[k] = load(k);
+
+	for (uint8_t t=0; t<sizeof(torn); t++) {
+		for (uint32_t cut=0; ; cut++) {
+			memcpy(hal_eeprom, base, sizeof(base));
+			ee_init();
+			hal_eeprom_writes = 0;
+			hal_eeprom_cut = cut;
+			hal_eeprom_torn = torn[t];
+			store_ee(val, key);
+			hal_eeprom_cut = UINT32_MAX;
+			bool done = hal_eeprom_writes <= cut;
+
+			ee_init();
+			for (uint8_t k=0; k<EE_N_KEYS; k++) {
+				int32_t v = load(k);
+				if (k != key)
+					CHECK_EQ(v, vals[k]);
+				else if (done)
+					CHECK_EQ(v, val);
+				else
+					CHECK(v == val || v == vals[k]);
+			}
+
+			store_ee(val + 1, key);
+			ee_init();
+			CHECK_EQ(load(key), val + 1);
+			if (done)
+				break;
+		}
+	}
+
+	memcpy(hal_eeprom, base, sizeof(base));
+	ee_init();
+}
+
+TEST(ee_power_loss)
+{
+	begin();
+	for (uint8_t k=0; k<EE_N_KEYS; k++)
+		store_ee(k * 1000, k);
+	power_loss(12345, SL_I_VAL);
+
+	// the ring wrapped and the next slot holds an old record
+	for (int i=0; i<300; i++)
+		store_ee(i, i % 3);
+	power_loss(-7, SL_T_SET);
+	power_loss(-8, SL_AIR_KI);
+	end();
+}
+
+TEST(ee_wear)
+{
+	begin();
+	for (uint8_t k=0; k<EE_N_KEYS; k++)
+		store_ee(k, k);
+
+	// unchanged values are not written
+	hal_eeprom_writes = 0;
+	for (uint8_t k=0; k<EE_N_KEYS; k++)
+		store_ee(k, k);
+	CHECK_EQ(hal_eeprom_writes, 0);
+
+	// 8 byte records for 4 byte values, the records which are re-written
+	// for their age included
+	const long n = 3L * EE_MAX_AGE;
+	hal_eeprom_writes = 0;
+	for (long i=0; i<n; i++)
+		store_ee(i * 7919, SL_I_VAL);
+	CHECK(hal_eeprom_writes <= n * 8 * 1.01);
+	CHECK_EQ(load(SL_T_SET), SL_T_SET);
+	CHECK_EQ(load(SL_AIR_KI), SL_AIR_KI);
+
+	// the boot scan reads the whole EEPROM once
+	hal_eeprom_reads = 0;
+	ee_init();
+	CHECK_EQ(hal_eeprom_reads, E2END + 1);
+	CHECK_EQ(load(SL_I_VAL), (n - 1) * 7919);
+	end();
+}
+
+BENCH(ee_init, n)
+{
+	begin();
+	for (int i=0; i<300; i++)
+		store_ee(i, i % EE_N_KEYS);
+	for (uint32_t i=0; i<n; i++)
+		ee_init();
+	end();
+}
@@ -0,0 +1,141 @@
+// Temperature filter pipeline of pid.h, replaying recorded readings
+#include <stdlib.h>
+#include <math.h>
+#include "pid.h"
+#include "temp_sensor.h"
+#include "runner.h"
+#include "trace_brownout.h"
+
+#define N_TRACE (sizeof(trace_brownout) / sizeof(trace_brownout[0]))
+#define POR_RAW 0x0550
+
+enum { STAGE_POR, STAGE_SPIKE, STAGE_RATE, STAGE_AVG };
+
+static fp16 reading(int16_t raw)
+{
+	return ds_temp::from_raw(raw).to<FP_FRAC>();
+}
+
+// like filter_temp() in pid.cpp
+static bool run(temp_filter *f, int16_t raw, fp16 *out)
+{
+	fp16 x = reading(raw);
+	if (!(*f)(x))
+		return false;
+	*out = x;
+	return true;
+}
+
+TEST(filter_replay_brownout)
+{
+	for (uint8_t ch=0; ch<2; ch++) {
+		temp_filter f = {};
+		fp16 out = reading(trace_brownout[0][ch]);
+		unsigned n_por = 0;
+		int16_t last_real = trace_brownout[0][ch];
+
+		for (unsigned i=0; i<N_TRACE; i++) {
+			int16_t raw = trace_brownout[i][ch];
+			if (raw == POR_RAW)
+				n_por++;
+			else
+				last_real = raw;
+
+			CHECK_EQ(run(&f, raw, &out), raw != POR_RAW);
+			// follows the real readings, the average lags 2 samples
+			CHECK((out - reading(last_real)).abs() <= fp16::from(0.25));
+		}
+
+		uint16_t c[temp_filter::n_stages];
+		f.counters(c);
+		CHECK(n_por >= 2);
+		CHECK_EQ(c[STAGE_POR], n_por);
+		CHECK_EQ(c[STAGE_SPIKE], 0);
+		CHECK_EQ(c[STAGE_RATE], 0);
+	}
+}
+
+// a sensor which browned out before the first reading
+TEST(filter_por_first)
+{
+	temp_filter f = {};
+	fp16 out = fp16::from(-1);
+
+	CHECK(!run(&f, POR_RAW, &out));
+	CHECK(out == fp16::from(-1));
+	for (int i=0; i<10; i++)
+		CHECK(run(&f, 20 * 16, &out));
+	CHECK(out == fp16::from(20));
+
+	uint16_t c[temp_filter::n_stages];
+	f.counters(c);
+	CHECK_EQ(c[STAGE_POR], 1);
+}
+
+// the recorded warm-up with a single sample glitch and a jump on top
+TEST(filter_replay_spikes)
+{
+	temp_filter f = {};
+	fp16 out = {0};
+	const unsigned i_spike = 100, i_jump = 200;
+
+	for (unsigned i=0; i<N_TRACE; i++) {
+		int16_t raw = trace_brownout[i][0];
+		if (raw == POR_RAW)
+			raw = trace_brownout[i - 1][0];
+		if (i == i_spike)
+			raw += 10 * 16;
+		if (i >= i_jump)
+			raw += 3 * 16;
+		run(&f, raw, &out);
+
+		// the spike never shows
+		if (i >= i_spike && i < i_spike + 4)
+			CHECK((out - reading(trace_brownout[i][0])).abs() <= fp16::from(0.25));
+		// the jump comes through, limited to 1 degC per sample
+		if (i == i_jump + 8)
+			CHECK((out - reading(raw)).abs() <= fp16::from(0.25));
+	}
+
+	uint16_t c[temp_filter::n_stages];
+	f.counters(c);
+	// the spike and the first sample of the jump, delayed by one
+	CHECK_EQ(c[STAGE_SPIKE], 2);
+	CHECK(c[STAGE_RATE] >= 1);
+}
+
+// first order low pass: step response against y += (x - y) / 8 in double
+// precision, also across zero
+TEST(filter_iir_step)
+{
+	const int16_t steps[][2] = {{20, 30}, {30, 20}, {-5, 5}};
+	for (auto &s : steps) {
+		pipeline<iir<fp16, 3> > f = {};
+		fp16 x = fp16::from(s[0]);
+		CHECK(f(x));
+		CHECK(x == fp16::from(s[0]));
+
+		const double y0 = fp16::from(s[0]).raw, u = fp16::from(s[1]).raw;
+		double y = y0;
+		fp16 last = x;
+		for (int i=1; i<=100; i++) {
+			x = fp16::from(s[1]);
+			CHECK(f(x));
+			y += (u - y) / 8;
+			CHECK(fabs(x.raw - y) <= 1);
+			// no overshoot, never moves back
+			CHECK(s[1] > s[0] ? x >= last && x <= fp16::from(s[1]) :
+				x <= last && x >= fp16::from(s[1]));
+			// 63 % of the step after ~2^K samples
+			if (i == 8)
+				CHECK(fabs(x.raw - y0) >= 0.6 * fabs(u - y0));
+			last = x;
+		}
+		// settles on the input exactly
+		CHECK(x == fp16::from(s[1]));
+
+		uint16_t c[1];
+		f.counters(c);
+		CHECK_EQ(c[0], 0);
+	}
+}
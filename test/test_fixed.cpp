@@ -0,0 +1,116 @@
+// fixed.h, bit exact against the same arithmetic in double precision
+#include <stdlib.h>
+#include <math.h>
+#include "fixed.h"
+#include "pid.h"
+#include "runner.h"
+
+typedef fixed<int16_t, 6> q6;
+typedef fixed<int32_t, 14> q14;
+
+// round half up, what to<>() and mul() promise
+static long round_ref(double v)
+{
+	return (long)floor(v + 0.5);
+}
+
+TEST(fixed_to)
+{
+	for (long r=-0x8000; r<=0x7FFF; r++) {
+		q6 a = q6::from_raw(r);
+		CHECK_EQ(a.to<2>().raw, round_ref(r / 16.0));
+		CHECK_EQ(a.to<0>().raw, round_ref(r / 64.0));
+		CHECK_EQ(a.trunc<2>().raw, (long)trunc(r / 16.0));
+		CHECK_EQ(a.as<int32_t>().to<14>().raw, r * 256);
+		CHECK_EQ(a.as<int32_t>().to<14>().to<6>().raw, r);
+		CHECK_EQ(a.abs().raw, (int16_t)labs(r));
+	}
+}
+
+TEST(fixed_from)
+{
+	for (double v=-100; v<100; v+=0.37) {
+		if (v >= 0)
+			CHECK_EQ(fp16::from(v).raw, FP(v));
+		CHECK_EQ(fp16::from(v).raw, round_ref(v * 64));
+	}
+	CHECK_EQ(fp16::from(-2).raw, -128);
+	CHECK_EQ(fp16::from(-1.0 / 128).raw, 0);
+}
+
+TEST(fixed_mul)
+{
+	// q6 * q6 in q6, the product fits into int32 on the host
+	srand(4);
+	for (long i=0; i<1000000; i++) {
+		int16_t a = rand(), b = rand() % 0x1000 - 0x800;
+		q6 p = q6::from_raw(a).mul(q6::from_raw(b));
+		CHECK_EQ(p.raw, (int16_t)round_ref(a * (double)b / 64));
+	}
+	// 32 bit by a Q14 gain
+	for (long i=0; i<1000000; i++) {
+		int32_t a = rand() % 0x20000 - 0x10000;
+		int32_t b = rand() % 0x8000;
+		q14 p = q14::from_raw(a).mul(q14::from_raw(b));
+		CHECK_EQ(p.raw, round_ref(a * (double)b / (1 << 14)));
+	}
+	// integer factor, no rounding term
+	for (int k=-5; k<=5; k++)
+		CHECK_EQ(q6::from_raw(100).mul(fixed<int16_t, 0>::from_raw(k)).raw, 100 * k);
+}
+
+TEST(fixed_ops)
+{
+	q6 lo = q6::from(-2), hi = q6::from(3);
+	for (long r=-0x200; r<=0x200; r++) {
+		q6 a = q6::from_raw(r);
+		CHECK_EQ(a.clamp(lo, hi).raw, r < -128 ? -128 : r > 192 ? 192 : r);
+		CHECK_EQ((a / 3).raw, r / 3);
+		CHECK_EQ((a * 3).raw, r * 3);
+		CHECK_EQ((a - hi + hi).raw, r);
+		CHECK_EQ((-a).raw, -r);
+	}
+}
+
+// 16 bit sums and differences stop at the ends of the range
+TEST(fixed_sat)
+{
+	const long max = 0x7FFF, min = -0x8000;
+	for (long r=min; r<=max; r+=7) {
+		q6 a = q6::from_raw(r);
+		for (long d=-0x8000; d<=0x7FFF; d+=0x1111) {
+			q6 b = q6::from_raw(d);
+			long s = r + d, t = r - d;
+			s = s > max ? max : s < min ? min : s;
+			t = t > max ? max : t < min ? min : t;
+			CHECK_EQ((a + b).raw, s);
+			CHECK_EQ((a - b).raw, t);
+			q6 c = a;
+			c += b;
+			CHECK_EQ(c.raw, s);
+			c = a;
+			c -= b;
+			CHECK_EQ(c.raw, t);
+		}
+	}
+	q6 top = q6::from_raw(max), bottom = q6::from_raw(min);
+	q6 one = q6::from_raw(1);
+	CHECK_EQ((top + one).raw, max);
+	CHECK_EQ((bottom - one).raw, min);
+	CHECK_EQ((bottom + top).raw, -1);
+	CHECK_EQ((top - bottom).raw, max);
+	CHECK_EQ((-bottom).raw, max);
+	CHECK_EQ((-top).raw, -max);
+	// 32 bit formats keep the plain arithmetic
+	CHECK_EQ((q14::from_raw(0x40000000) - q14::from_raw(1)).raw, 0x3FFFFFFF);
+}
+
+// more fractional bits multiply, negative values included
+TEST(fixed_to_neg)
+{
+	CHECK_EQ(q6::from_raw(-1).to<8>().raw, -4);
+	CHECK_EQ(q6::from_raw(-100).to<10>().raw, -1600);
+	CHECK_EQ(q14::from_raw(-12345).to<20>().raw, -12345L * 64);
+	constexpr q6 c = q6::from(-1.5).to<6>();
+	static_assert(c.raw == -96, "to<>() stays constexpr");
+}
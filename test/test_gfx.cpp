@@ -0,0 +1,107 @@
+// Text rendering into the framebuffer: every font pixel is a size x size
+// block, at any y, for every text size. Benchmarks of the text and gui()
+#include <avr/pgmspace.h>
+#include <Arduino.h>
+#include "gfx.h"
+#include "print.h"
+#include "ssd1306.h"
+#include "main.h"
+#include "glcdfont.cpp"
+#include "runner.h"
+
+static void draw(uint8_t x, uint8_t y, uint8_t size, char c)
+{
+	uint8_t mux = print_mux;
+	print_mux = PRINT_OLED;
+	set_cursor(x, y);
+	set_size(size);
+	_putchar(c);
+	set_size(1);
+	print_mux = mux;
+}
+
+#ifndef SSD_PAGE_MODE
+TEST(gfx_char_blocks)
+{
+	const char chars[] = {'0', '8', 'A', 'g', '%', 0x7F};
+	for (uint8_t size=1; size<=4; size++) {
+		for (uint8_t y=0; y<=9; y++) {
+			for (char c : chars) {
+				fill(false);
+				const uint8_t x = 3;
+				draw(x, y, size, c);
+
+				unsigned n_bad = 0;
+				for (int py=0; py<DISPLAY_HEIGHT; py++) {
+					for (int px=0; px<DISPLAY_WIDTH; px++) {
+						int i = (px - x) / size, j = (py - y) / size;
+						bool ref = px >= x && py >= y && i < 5 && j < 8 &&
+							(pgm_read_byte(&font[(uint8_t)c * 5 + i]) >> j) & 1;
+						n_bad += getPixel(px, py) != ref;
+					}
+				}
+				CHECK_EQ(n_bad, 0);
+			}
+		}
+	}
+	fill(false);
+}
+#endif
+
+static void bench_draw(uint32_t n, uint8_t size)
+{
+	for (uint32_t i=0; i<n; i++)
+		draw(i % 64, 20, size, '0' + i % 10);
+	fill(false);
+}
+
+// host time, only the ratio between the sizes means something
+BENCH(draw_char_1, n)
+{
+	bench_draw(n, 1);
+}
+
+BENCH(draw_char_2, n)
+{
+	bench_draw(n, 2);
+}
+
+BENCH(draw_char_3, n)
+{
+	bench_draw(n, 3);
+}
+
+// gui() on the reading screen, host time per frame including the transfer
+// to the display model. A redraw of everything is what gui() did before
+// the widgets were retained, on every frame.
+static void bench_gui(uint32_t n, bool full, bool tick)
+{
+	uint32_t ms = ms_since_start;
+	gui_redraw();
+	gui(millis());
+	for (uint32_t i=0; i<n; i++) {
+		if (full)
+			gui_redraw();
+		if (tick)
+			ms_since_start += 1000;
+		gui(millis());
+	}
+	ms_since_start = ms;
+}
+
+// nothing changed
+BENCH(gui_steady, n)
+{
+	bench_gui(n, false, false);
+}
+
+// the seconds of the clock changed
+BENCH(gui_clock, n)
+{
+	bench_gui(n, false, true);
+}
+
+BENCH(gui_full, n)
+{
+	bench_gui(n, true, true);
+}
@@ -0,0 +1,34 @@
+// The native HAL itself
+#include <Arduino.h>
+#include "hal.h"
+#include "runner.h"
+
+TEST(hal_serial_drain)
+{
+	FILE *out = hal_serial_out;
+	hal_serial_out = NULL;
+	Serial.begin(115200);
+	hal_advance_us(10000);  // empty
+
+	// filling the buffer takes no time
+	uint64_t t0 = hal_time_us();
+	CHECK_EQ(Serial.availableForWrite(), 63);
+	for (int i=0; i<63; i++)
+		Serial.write('x');
+	CHECK_EQ(hal_time_us(), t0);
+	CHECK_EQ(Serial.availableForWrite(), 0);
+
+	// the next byte waits for one to go out: 10 bit at 115200 baud
+	uint64_t t1 = hal_time_us();
+	Serial.write('x');
+	CHECK_EQ(hal_time_us() - t1, 87);
+	CHECK_EQ(Serial.availableForWrite(), 0);
+
+	// drains at the baud rate
+	hal_advance_us(870);
+	CHECK_EQ(Serial.availableForWrite(), 10);
+	hal_advance_us(63 * 87);
+	CHECK_EQ(Serial.availableForWrite(), 63);
+
+	hal_serial_out = out;
+}
@@ -0,0 +1,102 @@
+// Hatch motor sequencing and position storage
+#include <limits.h>
+#include <Arduino.h>
+#include "hatch.h"
+#include "ee_store.h"
+#include "gfx.h"
+#include "main.h"
+#include "hal.h"
+#include "runner.h"
+
+static unsigned long ts;
+static unsigned long ts_off;  // motor disabled
+static unsigned long min_dead;  // shortest time between two runs
+static unsigned n_dir_change;  // direction switched with the motor on
+
+// hatch_tick() every 10 ms, like the task table
+static void run(unsigned long ms)
+{
+	for (unsigned long t=0; t<ms; t+=10) {
+		bool en = hal_pin[PIN_MOTOR_ENABLE];
+		bool dir = hal_pin[PIN_MOTOR_DIRECTION];
+		hatch_tick(ts += 10);
+		if (en && dir != hal_pin[PIN_MOTOR_DIRECTION])
+			n_dir_change++;
+		if (en && !hal_pin[PIN_MOTOR_ENABLE])
+			ts_off = ts;
+		if (!en && hal_pin[PIN_MOTOR_ENABLE] && ts - ts_off < min_dead)
+			min_dead = ts - ts_off;
+	}
+}
+
+// moves to `pos` and waits until it is stored
+static void start(int16_t pos)
+{
+	ts = millis() + 1000000UL;
+	run(HATCH_STORE_IDLE);
+	CHECK(!hatch_busy());
+	hatch_move(pos - hatch_pos());
+	run(MAX_HATCH * HATCH_STEP_TIME + HATCH_STORE_IDLE);
+	CHECK_EQ(hatch_pos(), pos);
+}
+
+static int32_t stored()
+{
+	int32_t v = -1;
+	load_ee(&v, SL_HATCH_POS);
+	return v;
+}
+
+TEST(hatch_reversal)
+{
+	uint8_t mux = print_mux;
+	print_mux = 0;
+	start(10);
+	ts_off = 0;
+	min_dead = ULONG_MAX;
+	n_dir_change = 0;
+
+	// opening, then closing and opening again while the motor runs
+	hatch_move(5);
+	run(2 * HATCH_STEP_TIME);
+	hatch_move(-10);
+	run(4 * HATCH_STEP_TIME);
+	CHECK(hatch_pos() < 12);
+	hatch_move(10);
+	run(20 * HATCH_STEP_TIME);
+	CHECK(!hatch_busy());
+	CHECK_EQ(hatch_pos(), 15);
+	CHECK_EQ(n_dir_change, 0);
+	CHECK(min_dead >= HATCH_SETTLE_TIME);
+	CHECK(min_dead < ULONG_MAX);
+
+	print_mux = mux;
+}
+
+TEST(hatch_store)
+{
+	uint8_t mux = print_mux;
+	print_mux = 0;
+	const int16_t pos = 10;
+	start(pos);
+	CHECK_EQ(stored(), pos);
+
+	// small moves are stored once the hatch rests
+	hatch_move(1);
+	run(2 * HATCH_STEP_TIME);
+	hatch_move(-2);
+	run(4 * HATCH_STEP_TIME);
+	CHECK(!hatch_busy());
+	CHECK_EQ(hatch_pos(), pos - 1);
+	CHECK_EQ(stored(), pos);
+	run(HATCH_STORE_IDLE);
+	CHECK_EQ(stored(), pos - 1);
+
+	// large ones right away
+	hatch_move(-HATCH_STORE_STEPS);
+	run((HATCH_STORE_STEPS + 1) * HATCH_STEP_TIME + HATCH_SETTLE_TIME);
+	CHECK(!hatch_busy());
+	CHECK_EQ(stored(), pos - 1 - HATCH_STORE_STEPS);
+
+	print_mux = mux;
+}
@@ -0,0 +1,56 @@
+// Delta coded temperature history
+#include <stdlib.h>
+#include "hist.h"
+#include "main.h"
+#include "runner.h"
+
+#define AVG_CYCLES (HIST_PERIOD * 1000L / CYCLE_TIME)
+#define N_48H (48 * 3600 / HIST_PERIOD)
+// [degC * HIST_T_SCALE], rounded
+#define T_HIST(raw) (((raw) + (1 << (FP_FRAC - HIST_T_BITS - 1))) >> (FP_FRAC - HIST_T_BITS))
+
+static void feed(int16_t air, int16_t probe, int16_t power)
+{
+	for (long i=0; i<AVG_CYCLES; i++)
+		hist_update(fp16::from_raw(air), fp16::from_raw(probe),
+			fp16::from_raw(power));
+}
+
+// A fermentation run: the probe creeps up and down by up to 2 degC,
+// the air and the heater follow with some noise
+TEST(hist_48h)
+{
+	// finish a sample started by another test
+	uint16_t seq = hist_seq();
+	while (hist_seq() == seq)
+		hist_update(fp16::from_raw(FP(31)), fp16::from_raw(FP(31)), fp16());
+
+	static int16_t air[N_48H], probe[N_48H];
+	srand(1);
+	for (int i=0; i<N_48H; i++) {
+		int16_t drift = FP(2) * abs(i % 96 - 48) / 48;
+		probe[i] = FP(30) + drift + rand() % 8;
+		air[i] = FP(31) - drift / 2 + rand() % 16;
+		feed(air[i], probe[i], rand() % 0x4000);
+	}
+
+#ifdef SSD_PAGE_MODE
+	CHECK(!hist_dropped());
+	CHECK(hist_n() >= N_48H);
+#else
+	// the framebuffer leaves room for ~16 h only
+	CHECK(hist_dropped());
+#endif
+
+	// the newest samples come back rounded to HIST_T_SCALE
+	uint16_t n = hist_n() < N_48H ? hist_n() : N_48H;
+	struct hist_iter it;
+	hist_first(&it);
+	while (it.i < hist_n() - n)
+		hist_next(&it);
+	for (int i=N_48H - n; i<N_48H; i++) {
+		CHECK_EQ(it.s.air, T_HIST(air[i]));
+		CHECK_EQ(it.s.probe, T_HIST(probe[i]));
+		hist_next(&it);
+	}
+}
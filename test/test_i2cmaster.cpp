@@ -0,0 +1,286 @@
+// The real i2cmaster.cpp against a register model of the ATmega328 TWI
+// with one simulated slave. The firmware build swaps the driver for
+// i2c_native.cpp, so its state machine and ISR only run here.
+#include <stdio.h>
+#include <string>
+#include <avr/pgmspace.h>
+#include <compat/twi.h>
+#include <i2cmaster.h>
+#include "runner.h"
+
+#define SLAVE 0x3C
+
+// --------------------------------------------------------------
+//  TWI model
+// --------------------------------------------------------------
+// Bus trace, S: start, Sr: repeated start, P: stop, <xx: byte read
+static std::string bus;
+
+static int nack_byte = -1;  // the slave NACKs this data byte
+static uint8_t slave_tx;  // next byte the slave sends
+
+static uint8_t cr, sr = TW_NO_INFO, dr;
+static bool pending;  // TWINT was cleared, an operation is under way
+static bool owner;  // START sent, no STOP yet
+static bool sla_next, reading;
+static int n_data;
+static unsigned n_isr;
+static unsigned n_poll;  // TWCR polled by the main loop while busy
+static bool in_isr;
+
+static void trace(const char *fmt, unsigned b)
+{
+	char s[8];
+	snprintf(s, sizeof(s), fmt, b);
+	bus += s;
+}
+
+// the hardware finishes the operation started by the last TWCR write
+static void twi_step()
+{
+	if (!pending)
+		return;
+	pending = false;
+
+	if (cr & (1 << TWSTO)) {
+		if (owner)
+			bus += " P";
+		owner = false;
+		cr &= ~(1 << TWSTO);
+		if (!(cr & (1 << TWSTA))) {
+			// TWINT is not set after a STOP
+			sr = TW_NO_INFO;
+			return;
+		}
+	}
+
+	if (cr & (1 << TWSTA)) {
+		bus += owner ? " Sr" : " S";
+		sr = owner ? TW_REP_START : TW_START;
+		owner = true;
+		sla_next = true;
+	} else if (sla_next) {
+		bool ack = (dr >> 1) == SLAVE;
+		trace(" %02X", dr);
+		sla_next = false;
+		reading = dr & I2C_READ;
+		n_data = 0;
+		if (reading)
+			sr = ack ? TW_MR_SLA_ACK : TW_MR_SLA_NACK;
+		else
+			sr = ack ? TW_MT_SLA_ACK : TW_MT_SLA_NACK;
+	} else if (reading) {
+		dr = slave_tx++;
+		trace(" <%02X", dr);
+		sr = (cr & (1 << TWEA)) ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+	} else {
+		trace(" %02X", dr);
+		sr = n_data++ == nack_byte ? TW_MT_DATA_NACK : TW_MT_DATA_ACK;
+	}
+	cr |= 1 << TWINT;
+}
+
+// Writing TWINT = 1 clears the flag and starts the next operation,
+// writing 0 leaves it alone. Polling TWCR lets the hardware finish.
+struct twcr_reg {
+	operator uint8_t() const
+	{
+		if (pending && !in_isr)
+			n_poll++;
+		twi_step();
+		return cr;
+	}
+	twcr_reg &operator=(uint8_t v)
+	{
+		bool go = v & (1 << TWINT);
+		cr = (v & ~(1 << TWINT)) | (go ? 0 : cr & (1 << TWINT));
+		pending = go && (v & (1 << TWEN));
+		return *this;
+	}
+};
+
+struct twsr_reg {
+	operator uint8_t() const { return sr; }
+	twsr_reg &operator=(uint8_t) { return *this; }
+};
+
+struct twdr_reg {
+	operator uint8_t() const { return dr; }
+	twdr_reg &operator=(uint8_t v) { dr = v; return *this; }
+};
+
+static twcr_reg twi_cr;
+static twsr_reg twi_sr;
+static twdr_reg twi_dr;
+
+#define TWCR twi_cr
+#define TWSR twi_sr
+#define TWDR twi_dr
+// the header was included above, declare the driver in the namespace too
+#undef _I2CMASTER_H
+#undef i2c_read
+namespace twi {
+#include "../src/i2cmaster.cpp"
+}
+#undef TWCR
+#undef TWSR
+#undef TWDR
+
+// time passes: the operation finishes and the interrupt is taken
+static void twi_run()
+{
+	twi_step();
+	if ((cr & (1 << TWINT)) && (cr & (1 << TWIE))) {
+		n_isr++;
+		in_isr = true;
+		twi::TWI_vect();
+		in_isr = false;
+	}
+}
+
+static void twi_reset()
+{
+	while (twi::i2c_busy())
+		twi_run();
+	bus.clear();
+	nack_byte = -1;
+	slave_tx = 0xA0;
+	n_isr = 0;
+	n_poll = 0;
+}
+
+// --------------------------------------------------------------
+//  Tests
+// --------------------------------------------------------------
+TEST(i2c_blocking)
+{
+	twi::i2c_init();
+	twi_reset();
+
+	CHECK_EQ(twi::i2c_start(SLAVE << 1 | I2C_WRITE), 0);
+	CHECK_EQ(twi::i2c_write(0x00), 0);
+	CHECK_EQ(twi::i2c_write(0xAE), 0);
+	CHECK_EQ(twi::i2c_rep_start(SLAVE << 1 | I2C_READ), 0);
+	CHECK_EQ(twi::i2c_readAck(), 0xA0);
+	CHECK_EQ(twi::i2c_readNak(), 0xA1);
+	twi::i2c_stop();
+	CHECK(bus == " S 78 00 AE Sr 79 <A0 <A1 P");
+
+	bus.clear();
+	CHECK_EQ(twi::i2c_start(0x50 << 1 | I2C_WRITE), 1);
+	twi::i2c_stop();
+	CHECK(bus == " S A0 P");
+
+	bus.clear();
+	nack_byte = 1;
+	CHECK_EQ(twi::i2c_start(SLAVE << 1 | I2C_WRITE), 0);
+	CHECK_EQ(twi::i2c_write(0x40), 0);
+	CHECK_EQ(twi::i2c_write(0x55), 1);
+	twi::i2c_stop();
+	CHECK(bus == " S 78 40 55 P");
+	CHECK_EQ(n_isr, 0);
+	// the caller waits for every START, byte and STOP
+	CHECK_EQ(n_poll, 17);
+}
+
+static const uint8_t pgm_dat[] PROGMEM = {0x01, 0x02, 0x03};
+
+static uint8_t n_done, last_status;
+static twi::i2c_xfer *requeue;
+
+static void done(unsigned char status)
+{
+	n_done++;
+	last_status = status;
+	// queued from the ISR, like the display driver does
+	if (requeue) {
+		twi::i2c_queue(requeue);
+		requeue = NULL;
+	}
+}
+
+static void run_queue()
+{
+	for (int i=0; i<100 && twi::i2c_busy(); i++)
+		twi_run();
+	CHECK(!twi::i2c_busy());
+}
+
+TEST(i2c_queue)
+{
+	static const uint8_t win[] = {0x21, 0x10, 0x1F};
+	static uint8_t dat[] = {0xAA, 0x55};
+	twi::i2c_xfer x_win = {SLAVE << 1, I2C_XF_PGM | I2C_XF_PREFIX | I2C_XF_NOSTOP,
+		0x00, pgm_dat, sizeof(pgm_dat), done, 0};
+	twi::i2c_xfer x_dat = {SLAVE << 1, I2C_XF_PREFIX, 0x40, dat, sizeof(dat), done, 0};
+	twi::i2c_xfer x_cmd = {SLAVE << 1, 0, 0, win, sizeof(win), done, 0};
+
+	twi::i2c_init();
+	twi_reset();
+	n_done = 0;
+
+	// repeated start after NOSTOP, STOP + START otherwise
+	CHECK_EQ(twi::i2c_queue(&x_win), 0);
+	CHECK_EQ(twi::i2c_queue(&x_dat), 0);
+	CHECK_EQ(twi::i2c_queue(&x_cmd), 0);
+	CHECK_EQ(x_win.status, I2C_XF_BUSY);
+	CHECK(twi::i2c_busy());
+	CHECK_EQ(twi::i2c_queue(&x_cmd), 1);
+	run_queue();
+	CHECK(bus == " S 78 00 01 02 03 Sr 78 40 AA 55 P S 78 21 10 1F P");
+	CHECK_EQ(n_done, 3);
+	CHECK_EQ(x_win.status, 0);
+	CHECK_EQ(x_dat.status, 0);
+	CHECK_EQ(x_cmd.status, 0);
+	// one interrupt per START and byte, the address included, the main
+	// loop only waits for the last STOP
+	CHECK_EQ(n_isr, 6 + 5 + 5);
+	CHECK_EQ(n_poll, 1);
+
+	// a transaction queued from the done callback goes out as well
+	bus.clear();
+	requeue = &x_cmd;
+	twi::i2c_queue(&x_dat);
+	run_queue();
+	CHECK(bus == " S 78 40 AA 55 P S 78 21 10 1F P");
+	CHECK_EQ(n_done, 5);
+
+	// the blocking API waits for the queue
+	bus.clear();
+	twi::i2c_queue(&x_cmd);
+	CHECK(twi::i2c_busy());
+	while (twi::i2c_busy())
+		twi_run();
+	CHECK_EQ(twi::i2c_start(SLAVE << 1 | I2C_WRITE), 0);
+	twi::i2c_stop();
+	CHECK(bus == " S 78 21 10 1F P S 78 P");
+}
+
+TEST(i2c_queue_nack)
+{
+	static uint8_t dat[] = {0x11, 0x22, 0x33};
+	twi::i2c_xfer x_bad = {0x50 << 1, I2C_XF_NOSTOP, 0, dat, sizeof(dat), done, 0};
+	twi::i2c_xfer x_dat = {SLAVE << 1, I2C_XF_PREFIX, 0x40, dat, sizeof(dat), done, 0};
+
+	twi::i2c_init();
+	twi_reset();
+	n_done = 0;
+
+	// an address NACK releases the bus even with NOSTOP
+	twi::i2c_queue(&x_bad);
+	twi::i2c_queue(&x_dat);
+	run_queue();
+	CHECK(bus == " S A0 P S 78 40 11 22 33 P");
+	CHECK_EQ(x_bad.status, 1);
+	CHECK_EQ(x_dat.status, 0);
+	CHECK_EQ(n_done, 2);
+
+	// a data NACK aborts the transaction
+	bus.clear();
+	nack_byte = 2;
+	twi::i2c_queue(&x_dat);
+	run_queue();
+	CHECK(bus == " S 78 40 11 22 P");
+	CHECK_EQ(x_dat.status, 1);
+	CHECK_EQ(last_status, 1);
+}
@@ -0,0 +1,151 @@
+// Virtual tempeh sensor on the plant it models, with noisy readings: the
+// estimate with and without the probe, the ambient identified from the
+// probe, a probe which goes off is flagged and not followed
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <avr/pgmspace.h>
+#include "kalman.h"
+#include "hatch.h"
+#include "main.h"
+#include "uart_log.h"
+#include "print.h"
+#include "prof.h"
+#include "gfx.h"
+#include "runner.h"
+
+// a filter of its own, from power-up
+namespace kf {
+#include "../src/kalman.cpp"
+}
+
+// temperatures [degC], heat of fermentation [W]
+struct box {
+	double plate, air, tempeh, amb;
+	double heat;
+};
+
+static void box_init(struct box *b, double t, double amb)
+{
+	b->plate = b->air = b->tempeh = t;
+	b->amb = amb;
+	b->heat = 0;
+}
+
+// one control cycle at heater duty u = 0 ... 1
+static void box_step(struct box *b, double u)
+{
+	double dt = CYCLE_TIME / 1000.0;
+	double q_pa = KF_G_PLATE_AIR * (b->plate - b->air);
+	double q_at = KF_G_AIR_TEMPEH * (b->air - b->tempeh);
+	double g_amb = KF_G_AIR_AMB + KF_G_HATCH * hatch_pos() / MAX_HATCH;
+	double q_amb = g_amb * (b->air - b->amb);
+	b->plate += dt / KF_C_PLATE * (KF_P_HEATER * u - q_pa);
+	b->air += dt / KF_C_AIR * (q_pa - q_at - q_amb);
+	b->tempeh += dt / KF_C_TEMPEH * (q_at + b->heat);
+}
+
+// sensor reading, ~0.1 degC of noise and the 1/16 degC of the DS18B20
+static fp16 reading(double t)
+{
+	static uint32_t seed = 1;
+	double n = 0;
+	for (int i=0; i<4; i++) {
+		seed = seed * 1103515245 + 12345;
+		n += (seed >> 16 & 0x7FFF) / 32768.0 - 0.5;
+	}
+	return fp16::from_raw(lround((t + 0.17 * n) * 16) * FP_SCALE / 16);
+}
+
+static void restart()
+{
+	kf::n_steps = 0;
+	kf::n_off[0] = kf::n_off[1] = 0;
+	kf::n_on[0] = kf::n_on[1] = 0;
+	kf::suspect = 0;
+}
+
+// state of the filter [degC]
+static double est(uint8_t i)
+{
+	return kf::x[i] / (double)(1L << Q_X);
+}
+
+// heater duty of the first hours: warming up, then a square wave
+static double duty(long k)
+{
+	if (k < 3600)
+		return 0.3;
+	return (k / 1800) % 2 ? 0.05 : 0.15;
+}
+
+// runs n cycles from cycle k, probe_off is added to the probe reading,
+// returns the largest error of the estimate in the last hour
+static double run(struct box *b, long k, long n, bool has_probe, double probe_off)
+{
+	double err = 0;
+	for (long i=k; i<k + n; i++) {
+		double u = duty(i);
+		kf::kalman_step(reading(b->air), reading(b->tempeh + probe_off), has_probe,
+			fp16::from_raw(lround(u * 0xFF * FP_SCALE)));
+		box_step(b, u);
+		if (i >= k + n - 3600)
+			err = fmax(err, fabs(est(kf::TEMPEH) - b->tempeh));
+	}
+	return err;
+}
+
+TEST(kalman_probe)
+{
+	uint8_t mux = print_mux;
+	print_mux = 0;
+
+	// the box starts cooler than the room, the ambient is off by 3 degC
+	struct box b;
+	box_init(&b, 20, 23);
+	b.heat = 0.3;
+	restart();
+	double err = run(&b, 0, 8 * 3600L, true, 0);
+	CHECK(kf::kalman_valid());
+	CHECK(err < 0.1);
+	CHECK(fabs(est(kf::AMB) - b.amb) < 0.3);
+	CHECK_EQ(kf::kalman_suspect(), 0);
+
+	// the probe is pulled out of the tempeh, its reading drops by 3 degC.
+	// The readings are gated, the estimate stays where it was
+	double t = est(kf::TEMPEH);
+	run(&b, 8 * 3600L, KF_N_SUSPECT - 1, true, -3);
+	CHECK_EQ(kf::kalman_suspect(), 0);
+	CHECK(fabs(est(kf::TEMPEH) - t) < 0.05);
+	// until the probe is flagged
+	run(&b, 8 * 3600L + KF_N_SUSPECT, 1, true, -3);
+	CHECK_EQ(kf::kalman_suspect(), KF_SUSPECT_PROBE);
+
+	// and put back, the flag is cleared after KF_N_AGREE readings in a row
+	// inside the gate. The first few after the jump may be outside.
+	run(&b, 9 * 3600L, KF_N_AGREE - 1, true, 0);
+	CHECK_EQ(kf::kalman_suspect(), KF_SUSPECT_PROBE);
+	run(&b, 10 * 3600L, KF_N_SUSPECT, true, 0);
+	CHECK_EQ(kf::kalman_suspect(), 0);
+
+	print_mux = mux;
+}
+
+TEST(kalman_no_probe)
+{
+	// from the air reading alone, the ambient right
+	struct box b;
+	box_init(&b, 22, 22);
+	restart();
+	double err = run(&b, 0, 8 * 3600L, false, 0);
+	CHECK(err < 0.15);
+	CHECK_EQ(kf::kalman_suspect(), 0);
+
+	// the heat of fermentation is not in the model, the process noise of
+	// the tempeh covers it
+	box_init(&b, 22, 22);
+	b.heat = 0.3;
+	restart();
+	err = run(&b, 0, 8 * 3600L, false, 0);
+	CHECK(err < 0.2);
+}
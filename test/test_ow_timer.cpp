@@ -0,0 +1,392 @@
+// The real ow_timer.cpp against a model of Timer1, port B and a DS18B20
+// on the bus. The firmware build swaps the driver for ow_native.cpp, so
+// its time slots only run here.
+#include <string.h>
+#include <util/delay.h>
+#include "ow_timer.h"
+#include "crc.h"
+#include "main.h"
+#include "prof.h"
+#include "runner.h"
+
+#define OW_PIN (1 << 1)
+
+// Timer1 ticks for a duration in [us]
+#define T_US(t) ((uint64_t)(t) * (F_CPU / 1000000UL))
+
+// --------------------------------------------------------------
+//  Time, interrupts
+// --------------------------------------------------------------
+static uint64_t now;  // [Timer1 ticks]
+
+// from the compare match to the ISR, other interrupts included
+static uint64_t isr_latency;
+// longest time from a compare match to the end of its ISR
+static uint64_t irq_off;
+
+// a register access takes 2 cycles
+static void io() { now += 2; }
+
+// --------------------------------------------------------------
+//  DS18B20 model
+// --------------------------------------------------------------
+static bool present;
+static uint8_t rom[8] = {0x28, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0};
+static uint8_t scratch[9];
+static int16_t temp;  // latched by CONVERT T
+static uint8_t n_conv;
+
+enum { S_ROM, S_MATCH, S_FUNC, S_READ, S_IDLE };
+static uint8_t s_state;
+static uint8_t s_byte, s_bit;  // byte being received, bit count
+static uint8_t n_match;
+static uint8_t tx_bit;  // next scratchpad bit to send
+
+static uint64_t t_fall;  // master pulled the bus low
+static uint64_t pres_from, pres_to;  // presence pulse
+static uint64_t hold_to;  // the slave sends a 0
+static bool m_low;  // the master pulls the bus low
+static uint64_t t_power;  // strong pull-up switched on
+
+// timing violations seen by the slave
+static unsigned n_bad;
+static uint64_t sample_max;  // latest sample of a read slot after t_fall
+
+// bit by bit, to check the table of crc.cpp
+static uint8_t ds_crc8(const uint8_t *p, uint8_t len)
+{
+	uint8_t crc = 0;
+	while (len--) {
+		uint8_t b = *p++;
+		for (uint8_t i=0; i<8; i++) {
+			crc = ((crc ^ b) & 1) ? (crc >> 1) ^ 0x8C : crc >> 1;
+			b >>= 1;
+		}
+	}
+	return crc;
+}
+
+static void slave_byte(uint8_t b)
+{
+	switch (s_state) {
+	case S_ROM:
+		s_state = b == 0xCC ? S_FUNC : b == 0x55 ? S_MATCH : S_IDLE;
+		n_match = 0;
+		break;
+	case S_MATCH:
+		if (b != rom[n_match])
+			s_state = S_IDLE;
+		else if (++n_match == 8)
+			s_state = S_FUNC;
+		break;
+	case S_FUNC:
+		s_state = S_IDLE;
+		if (b == 0x44) {
+			scratch[0] = temp & 0xFF;
+			scratch[1] = temp >> 8;
+			scratch[8] = ds_crc8(scratch, 8);
+			n_conv++;
+		} else if (b == 0xBE) {
+			s_state = S_READ;
+			tx_bit = 0;
+		}
+		break;
+	}
+}
+
+static bool bus_high()
+{
+	bool slave_low = present && ((now >= pres_from && now < pres_to) || now < hold_to);
+	return !m_low && !slave_low;
+}
+
+// the slave watches the edges the master makes
+static void master_edge(bool low)
+{
+	if (low == m_low)
+		return;
+	m_low = low;
+
+	if (low) {
+		// a read slot: a 0 is held for 30 us
+		if (s_state == S_READ && tx_bit < 72) {
+			if (!(scratch[tx_bit / 8] >> (tx_bit % 8) & 1))
+				hold_to = now + T_US(30);
+			tx_bit++;
+		}
+		t_fall = now;
+		return;
+	}
+
+	uint64_t d = now - t_fall;
+	if (d >= T_US(480)) {
+		pres_from = now + T_US(30);
+		pres_to = now + T_US(150);
+		s_state = S_ROM;
+		s_bit = 0;
+		return;
+	}
+	if (s_state == S_READ) {
+		if (d > T_US(15))
+			n_bad++;
+		return;
+	}
+
+	// write slot: a 1 releases within 15 us, a 0 is held for 60 us
+	if (d > T_US(15) && d < T_US(60))
+		n_bad++;
+	s_byte = (s_byte >> 1) | (d <= T_US(15) ? 0x80 : 0);
+	if (++s_bit == 8) {
+		s_bit = 0;
+		slave_byte(s_byte);
+	}
+}
+
+// --------------------------------------------------------------
+//  Registers
+// --------------------------------------------------------------
+static uint8_t tccr1a, tccr1b, timsk1, tifr1, pcicr, pcifr, pcmsk0;
+static uint16_t ocr1a;
+
+static void bus_update();
+
+// PORTB / DDRB: the master pulls low with DDR = 1, PORT = 0
+struct port_reg {
+	uint8_t v;
+	operator uint8_t() const { return v; }
+	port_reg &operator=(uint8_t x)
+	{
+		io();
+		v = x;
+		bus_update();
+		return *this;
+	}
+	port_reg &operator|=(uint8_t x) { return *this = v | x; }
+	port_reg &operator&=(uint8_t x) { return *this = v & x; }
+};
+
+static port_reg portb, ddrb;
+
+static void bus_update()
+{
+	bool out = ddrb.v & OW_PIN;
+	if (out && (portb.v & OW_PIN) && !t_power)
+		t_power = now;
+	master_edge(out && !(portb.v & OW_PIN));
+}
+
+struct pin_reg {
+	operator uint8_t() const
+	{
+		io();
+		if (s_state == S_READ && now - t_fall > sample_max)
+			sample_max = now - t_fall;
+		return bus_high() ? OW_PIN : 0;
+	}
+};
+
+struct tcnt_reg {
+	operator uint16_t() const
+	{
+		io();
+		return (uint16_t)now;
+	}
+};
+
+static pin_reg pinb;
+static tcnt_reg tcnt1;
+
+#define PORTB portb
+#define DDRB ddrb
+#define PINB pinb
+#define TCNT1 tcnt1
+#define OCR1A ocr1a
+#define TCCR1A tccr1a
+#define TCCR1B tccr1b
+#define TIMSK1 timsk1
+#define TIFR1 tifr1
+#define PCICR pcicr
+#define PCIFR pcifr
+#define PCMSK0 pcmsk0
+// a busy wait in the driver shows up as interrupt off time
+#undef _delay_us
+#define _delay_us(us) (now += T_US(us))
+// the header was included above, declare the driver in the namespace too
+#undef OW_TIMER_H
+namespace ow {
+#include "../src/ow_timer.cpp"
+}
+#undef PORTB
+#undef DDRB
+#undef PINB
+#undef TCNT1
+#undef OCR1A
+#undef TCCR1A
+#undef TCCR1B
+#undef TIMSK1
+#undef TIFR1
+#undef PCICR
+#undef PCIFR
+#undef PCMSK0
+
+// run the model for `us`, the interrupts are taken as they come
+static void run(uint32_t us)
+{
+	uint64_t end = now + T_US(us);
+	while (now < end) {
+		bool high = bus_high();
+		uint64_t next = end;
+		uint64_t t_cmp = UINT64_MAX;
+		if (timsk1 & (1 << OCIE1A)) {
+			uint16_t d = ocr1a - (uint16_t)now;
+			t_cmp = now + (d ? d : 0x10000);
+			if (t_cmp < next)
+				next = t_cmp;
+		}
+		const uint64_t slave[] = {pres_from, pres_to, hold_to};
+		for (uint8_t i=0; i<3; i++)
+			if (slave[i] > now && slave[i] < next)
+				next = slave[i];
+		now = next;
+
+		if (bus_high() != high && (pcicr & (1 << PCIE0)) && (pcmsk0 & OW_PIN))
+			ow::PCINT0_vect();
+
+		if (now == t_cmp) {
+			now += isr_latency;
+			ow::TIMER1_COMPA_vect();
+			if (now - t_cmp > irq_off)
+				irq_off = now - t_cmp;
+		}
+	}
+}
+
+static void model_reset(bool p)
+{
+	present = p;
+	isr_latency = T_US(3);
+	irq_off = 0;
+	n_bad = 0;
+	sample_max = 0;
+	t_power = 0;
+	s_state = S_IDLE;
+	rom[7] = ds_crc8(rom, 7);
+	ow::ow_init();
+}
+
+static void run_queue()
+{
+	for (int i=0; i<100 && ow::ow_busy(); i++)
+		run(1000);
+	CHECK(!ow::ow_busy());
+}
+
+// --------------------------------------------------------------
+//  Tests
+// --------------------------------------------------------------
+TEST(ow_read)
+{
+	static const uint8_t cmd_conv[] = {0xCC, 0x44};
+	static const uint8_t cmd_read[] = {0xCC, 0xBE};
+	uint8_t rx[9];
+	ow::ow_xfer xf_conv = {cmd_conv, sizeof(cmd_conv), NULL, 0, OW_POWER, 0};
+	ow::ow_xfer xf_read = {cmd_read, sizeof(cmd_read), rx, sizeof(rx), 0, 0};
+
+	model_reset(true);
+	memset(scratch, 0xA5, sizeof(scratch));
+	temp = 0x0191;
+	n_conv = 0;
+
+	CHECK_EQ(ow::ow_queue(&xf_conv), 0);
+	CHECK_EQ(ow::ow_queue(&xf_read), 0);
+	CHECK(ow::ow_busy());
+	run_queue();
+	CHECK_EQ(xf_conv.status, OW_OK);
+	CHECK_EQ(xf_read.status, OW_OK);
+	CHECK_EQ(n_conv, 1);
+	CHECK(memcmp(rx, scratch, sizeof(rx)) == 0);
+	CHECK_EQ(crc8(rx, 8), rx[8]);
+
+	// slots within the limits of the data sheet, no busy waiting
+	CHECK_EQ(n_bad, 0);
+	CHECK(sample_max <= T_US(15));
+	CHECK(irq_off < T_US(5));
+}
+
+TEST(ow_power)
+{
+	static const uint8_t cmd_conv[] = {0xCC, 0x44};
+	ow::ow_xfer xf_conv = {cmd_conv, sizeof(cmd_conv), NULL, 0, OW_POWER, 0};
+
+	model_reset(true);
+	n_conv = 0;
+	ow::ow_queue(&xf_conv);
+	run_queue();
+	CHECK_EQ(xf_conv.status, OW_OK);
+	CHECK_EQ(n_conv, 1);
+	// strong pull-up for the conversion, within 10 us after the last
+	// slot, a 0 bit
+	CHECK((ddrb.v & OW_PIN) && (portb.v & OW_PIN));
+	CHECK(t_power > t_fall);
+	CHECK(t_power - t_fall <= T_US(60 + 10));
+}
+
+TEST(ow_match_rom)
+{
+	uint8_t cmd[10] = {0x55};
+	uint8_t rx[9];
+	ow::ow_xfer xf = {cmd, sizeof(cmd), rx, sizeof(rx), 0, 0};
+
+	model_reset(true);
+	memcpy(cmd + 1, rom, 8);
+	cmd[9] = 0xBE;
+	ow::ow_queue(&xf);
+	run_queue();
+	CHECK_EQ(xf.status, OW_OK);
+	CHECK(memcmp(rx, scratch, sizeof(rx)) == 0);
+
+	// nobody answers, the bus stays high
+	cmd[2] ^= 1;
+	ow::ow_queue(&xf);
+	run_queue();
+	CHECK_EQ(xf.status, OW_OK);
+	CHECK_EQ(rx[0], 0xFF);
+	CHECK_EQ(rx[8], 0xFF);
+	CHECK_EQ(n_bad, 0);
+}
+
+TEST(ow_no_presence)
+{
+	static const uint8_t cmd[] = {0xCC, 0xBE};
+	uint8_t rx[9];
+	ow::ow_xfer x1 = {cmd, sizeof(cmd), rx, sizeof(rx), 0, 0};
+	ow::ow_xfer x2 = {cmd, sizeof(cmd), rx, sizeof(rx), 0, 0};
+
+	model_reset(false);
+	ow::ow_queue(&x1);
+	ow::ow_queue(&x2);
+	run_queue();
+	CHECK_EQ(x1.status, OW_NO_PRESENCE);
+	CHECK_EQ(x2.status, OW_NO_PRESENCE);
+}
+
+TEST(ow_late)
+{
+	static const uint8_t cmd[] = {0xCC, 0xBE};
+	uint8_t rx[9];
+	ow::ow_xfer xf = {cmd, sizeof(cmd), rx, sizeof(rx), 0, 0};
+
+	// other interrupts delay the sample beyond 15 us
+	model_reset(true);
+	isr_latency = T_US(8);
+	ow::ow_queue(&xf);
+	run_queue();
+	CHECK_EQ(xf.status, OW_LATE);
+	CHECK(sample_max <= T_US(15));
+
+	isr_latency = T_US(4);
+	ow::ow_queue(&xf);
+	run_queue();
+	CHECK_EQ(xf.status, OW_OK);
+	CHECK(memcmp(rx, scratch, sizeof(rx)) == 0);
+}
@@ -0,0 +1,76 @@
+// Control cycle: sensor errors
+#include <Arduino.h>
+#include "pid.h"
+#include "temp_sensor.h"
+#include "gfx.h"
+#include "hal.h"
+#include "runner.h"
+
+// one control cycle, the transactions run during the second
+static void cycle()
+{
+	pid_cycle();
+	hal_advance_us(1000000);
+}
+
+TEST(pid_late_reading)
+{
+	uint8_t mux = print_mux;
+	print_mux = 0;
+	hal_ow_n = HAL_N_OW;
+	pid_init();
+	hal_advance_us(1000000);
+	for (int i=0; i<20; i++)
+		cycle();
+	CHECK(heater_enabled);
+
+	// a late slot now and then skips the cycle, the heater stays on
+	uint16_t misses = temp_misses;
+	for (int i=0; i<10; i++) {
+		hal_ow_late = 1;
+		cycle();
+		fp16 power = target_heater_power;
+		cycle();
+		CHECK(heater_enabled);
+		CHECK_EQ(target_heater_power.raw, power.raw);
+		cycle();
+	}
+	CHECK_EQ(temp_misses - misses, 10);
+
+	// so does a few in a row
+	hal_ow_late = 3 * (TEMP_N_MISS - 1);
+	for (int i=0; i<TEMP_N_MISS; i++)
+		cycle();
+	CHECK(heater_enabled);
+
+	// but not forever, the sensors are re-initialised
+	hal_ow_late = 3 * TEMP_N_MISS;
+	for (int i=0; i<TEMP_N_MISS + 1; i++)
+		cycle();
+	CHECK(!heater_enabled);
+
+	heater_enabled = true;
+	print_mux = mux;
+}
+
+TEST(pid_no_sensor)
+{
+	uint8_t mux = print_mux;
+	print_mux = 0;
+	hal_ow_n = HAL_N_OW;
+	pid_init();
+	hal_advance_us(1000000);
+	for (int i=0; i<5; i++)
+		cycle();
+	CHECK(heater_enabled);
+
+	// a missing sensor turns the heater off at once
+	hal_ow_n = 0;
+	cycle();
+	cycle();
+	CHECK(!heater_enabled);
+
+	hal_ow_n = HAL_N_OW;
+	heater_enabled = true;
+	print_mux = mux;
+}
@@ -0,0 +1,171 @@
+// Decimal conversions against the previous implementation with 32 bit
+// divisions (print_ref.cpp): every 16 bit value, unsigned and sign
+// extended, the values around the digit and word boundaries and random
+// 32 bit values
+#include <stdlib.h>
+#include <string.h>
+#include <Arduino.h>
+#include "hal.h"
+#include "print.h"
+#include "gfx.h"
+#include "uart_log.h"
+#include "runner.h"
+
+namespace print_ref {
+void print_udec(uint32_t val);
+void print_dec(int32_t val);
+void udec_dp(uint32_t val, const uint8_t n, const uint8_t dp, char *buf);
+void dec_dp(int32_t val, const uint8_t n, const uint8_t dp, char *buf);
+void udec_fix(uint32_t val, const uint8_t nFract, uint8_t nDigits, char *buf);
+void dec_fix(int32_t val, const uint8_t nFract, uint8_t nDigits, char *buf);
+}
+
+static unsigned n_bad;
+
+static void check_str(const char *a, const char *b, const char *fn, uint32_t v)
+{
+	if (strcmp(a, b) == 0)
+		return;
+	if (n_bad++ < 10)
+		printf("  %s(%lu): '%s', reference '%s'\n", fn, (unsigned long)v, a, b);
+}
+
+// the functions which convert to a buffer, all formats
+static void check_buf(uint32_t v)
+{
+	char a[32], b[32];
+	for (uint8_t n=1; n<=10; n++) {
+		for (uint8_t dp=0; dp<=n; dp++) {
+			udec_dp(v, n, dp, a);
+			print_ref::udec_dp(v, n, dp, b);
+			check_str(a, b, "udec_dp", v);
+			dec_dp(v, n, dp, a);
+			print_ref::dec_dp(v, n, dp, b);
+			check_str(a, b, "dec_dp", v);
+		}
+	}
+	for (uint8_t f=0; f<=8; f+=2) {
+		for (uint8_t d=0; d<=3; d++) {
+			udec_fix(v, f, d, a);
+			print_ref::udec_fix(v, f, d, b);
+			check_str(a, b, "udec_fix", v);
+			dec_fix(v, f, d, a);
+			print_ref::dec_fix(v, f, d, b);
+			check_str(a, b, "dec_fix", v);
+		}
+	}
+}
+
+static const uint32_t edges[] = {
+	0xFFFF, 99999, 999999, 9999999, 99999999, 999999999,
+	0x7FFFFFFF, 0xFFFFFFFF, 4000000000UL
+};
+
+static uint32_t random32()
+{
+	return ((uint32_t)rand() << 16) ^ rand() ^ ((uint32_t)rand() << 31);
+}
+
+// before the change, 2000000 were compared
+#define N_RANDOM 50000
+
+TEST(print_buf_vs_ref)
+{
+	n_bad = 0;
+	for (uint32_t v=0; v<=0xFFFF; v++) {
+		check_buf(v);
+		check_buf((int16_t)v);
+	}
+	for (uint8_t i=0; i<sizeof(edges) / sizeof(edges[0]); i++)
+		for (int d=-3; d<=3; d++)
+			check_buf(edges[i] + d);
+	srand(1);
+	for (long i=0; i<N_RANDOM; i++) {
+		uint32_t v = random32();
+		check_buf(v);
+		check_buf(v >> (rand() % 32));
+	}
+	CHECK_EQ(n_bad, 0);
+}
+
+// the 16 bit conversion on its own, zero padded to n digits
+TEST(print_udec16)
+{
+	n_bad = 0;
+	for (uint32_t v=0; v<=0xFFFF; v++) {
+		for (uint8_t n=1; n<=5; n++) {
+			char a[6], b[8];
+			unsigned len = udec16(v, n, a);
+			snprintf(b, sizeof(b), "%0*u", n, (unsigned)v);
+			CHECK_EQ(len, strlen(b));
+			check_str(a, b, "udec16", v);
+		}
+	}
+	CHECK_EQ(n_bad, 0);
+}
+
+// print_udec() and print_dec() only write to _putchar(), compare what
+// arrives on the serial port
+#define N_PRINT 4000
+
+static void print_all(void (*pu)(uint32_t), void (*pd)(int32_t))
+{
+	srand(3);
+	for (int i=0; i<N_PRINT; i++) {
+		uint32_t v = i < 1000 ? (uint32_t)(i - 500) : random32() >> (rand() % 32);
+		pu(v);
+		_putchar(' ');
+		pd(v);
+		_putchar('\n');
+	}
+}
+
+TEST(print_dec_vs_ref)
+{
+	FILE *f = tmpfile();
+	hal_serial_out = f;
+	Serial.begin(115200);
+	uint8_t mux = print_mux;
+	print_mux = PRINT_UART;
+	log_blocking(true);
+
+	print_all(print_udec, print_dec);
+	print_all(print_ref::print_udec, print_ref::print_dec);
+	for (int i=0; i<LOG_BUF_SIZE; i++) {
+		hal_advance_us(1000);
+		log_flush();
+	}
+
+	log_blocking(false);
+	print_mux = mux;
+	hal_serial_out = stdout;
+
+	static char s[2 * N_PRINT * 24];
+	fflush(f);
+	rewind(f);
+	size_t n = fread(s, 1, sizeof(s) - 1, f);
+	s[n] = 0;
+	fclose(f);
+
+	CHECK(n % 2 == 0);
+	CHECK(memcmp(s, s + n / 2, n / 2) == 0);
+}
+
+// host time, only the ratio means something for the AVR
+BENCH(udec_dp, n)
+{
+	char buf[16];
+	for (uint32_t i=0; i<n; i++) {
+		udec_dp(i * 2654435761UL, 10, 0, buf);
+		bench_keep(buf[0]);
+	}
+}
+
+BENCH(udec_dp_ref, n)
+{
+	char buf[16];
+	for (uint32_t i=0; i<n; i++) {
+		print_ref::udec_dp(i * 2654435761UL, 10, 0, buf);
+		bench_keep(buf[0]);
+	}
+}
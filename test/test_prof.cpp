@@ -0,0 +1,83 @@
+// Profiler with Timer1 of the native HAL: durations across the Timer1
+// overflow, the statistics in the report, which clears them
+#include <stdio.h>
+#include <string.h>
+#include <Arduino.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include "hal.h"
+#include "gfx.h"
+#include "print.h"
+#include "uart_log.h"
+#include "sram.h"
+#include "runner.h"
+
+// PROF is off in the firmware, the profiler is built here a second time
+// with it. With PROF on, both would have the Timer1 overflow ISR.
+#ifndef PROF
+#define PROF
+#include "prof.h"
+namespace pf {
+#include "../src/prof.cpp"
+}
+
+// report of prof_print()
+static void report(char *s, size_t size)
+{
+	hal_serial_out = tmpfile();
+	Serial.begin(115200);
+	uint8_t mux = print_mux;
+	print_mux = PRINT_UART;
+	pf::prof_print();
+	print_mux = mux;
+	for (int i=0; i<100; i++) {
+		hal_advance_us(5000);
+		log_flush();
+	}
+
+	FILE *f = hal_serial_out;
+	rewind(f);
+	size_t n = fread(s, 1, size - 1, f);
+	s[n] = 0;
+	fclose(f);
+	hal_serial_out = stdout;
+}
+
+// a probe around us of busy time
+static void timed(uint8_t id, uint32_t us)
+{
+	uint32_t t0 = pf::prof_now();
+	hal_advance_us(us);
+	pf::prof_end(id, t0);
+}
+
+TEST(prof_report)
+{
+	pf::prof_init();
+	// the flag is cleared by writing a one on the AVR, here it is a
+	// plain variable
+	TIFR1 = 0;
+	static char s[1024];
+	report(s, sizeof(s));
+
+	// 20 ms is 2.4 overflows of Timer1 at 8 MHz
+	timed(PROF_PID, 100);
+	timed(PROF_PID, 20000);
+	timed(PROF_PID, 300);
+	for (int i=0; i<4; i++)
+		pf::prof_add(PROF_OW, 12 + i * 8);
+
+	report(s, sizeof(s));
+	CHECK(strstr(s, "\npid           3    100.0  20000.0   6800.0\n"));
+	CHECK(strstr(s, "\nkalman        0\n"));
+	CHECK(strstr(s, "\now isr        4      1.5      4.5      3.0\n"));
+
+	// cleared by the report
+	report(s, sizeof(s));
+	CHECK(strstr(s, "\npid           0\n"));
+	CHECK(strstr(s, "\now isr        0\n"));
+
+	TIMSK1 &= ~(1 << TOIE1);
+}
+#endif
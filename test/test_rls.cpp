@@ -0,0 +1,118 @@
+// Online identification of the box model
+#include <stdlib.h>
+#include <math.h>
+#include "rls.h"
+#include "pid.h"
+#include "main.h"
+#include "runner.h"
+
+#define K 15.0  // [degC per full power]
+#define TAU 900.0  // [s]
+#define T_AMB 20.0  // [degC], below RLS_T_REF: negative regressors
+
+// The same estimator in double precision
+static struct {
+	double theta[3], P[3][3];
+	double sum_t, sum_u, last_t, last_u;
+	int n;
+	bool started;
+} ref;
+
+static void ref_update(double t, double u)
+{
+	ref.sum_t += t;
+	ref.sum_u += u;
+	if (++ref.n < RLS_DECIM)
+		return;
+	ref.n = 0;
+
+	if (!ref.started) {
+		for (int i=0; i<3; i++)
+			ref.P[i][i] = RLS_P0;
+		ref.started = true;
+	} else {
+		double x[3] = {
+			ref.last_t / RLS_DECIM - RLS_T_REF / (double)FP_SCALE,
+			ref.last_u / RLS_DECIM,
+			1
+		};
+		double e = (ref.sum_t - ref.last_t) / RLS_DECIM;
+		double px[3], xpx = 0;
+		for (int i=0; i<3; i++) {
+			px[i] = 0;
+			for (int j=0; j<3; j++)
+				px[i] += ref.P[i][j] * x[j];
+			xpx += px[i] * x[i];
+			e -= ref.theta[i] * x[i];
+		}
+		bool forget = ref.P[0][0] + ref.P[1][1] + ref.P[2][2] < 3 * RLS_P0;
+		double k[3];
+		for (int i=0; i<3; i++) {
+			k[i] = px[i] / (RLS_LAMBDA + xpx);
+			ref.theta[i] += k[i] * e;
+		}
+		for (int i=0; i<3; i++)
+			for (int j=0; j<3; j++) {
+				ref.P[i][j] -= k[i] * px[j];
+				if (forget)
+					ref.P[i][j] /= RLS_LAMBDA;
+			}
+	}
+	ref.last_t = ref.sum_t;
+	ref.last_u = ref.sum_u;
+	ref.sum_t = 0;
+	ref.sum_u = 0;
+}
+
+// first order box, heater switched between 20 % and 80 % at random.
+// Both estimators see the same quantized values
+static void run_plant(long n_cycles)
+{
+	double t = T_AMB;
+	double u = 0.2;
+	const double dt = CYCLE_TIME / 1000.0;
+
+	for (long i=0; i<n_cycles; i++) {
+		if (rand() % 600 == 0)
+			u = 1.0 - u;
+		t += dt / TAU * (K * u + T_AMB - t);
+
+		int16_t t_fp = FP(t), u_fp = FP(u * 0xFF);
+		rls_update(t_fp, u_fp);
+		ref_update((double)t_fp / FP_SCALE, (double)u_fp / POWER_MAX_LIMIT);
+	}
+}
+
+TEST(rls_identify)
+{
+	srand(2);
+	run_plant(6 * 3600L * 1000 / CYCLE_TIME);
+	CHECK(rls_valid());
+
+	int32_t gain, tau, ambient;
+	rls_model(&gain, &tau, &ambient);
+
+	// fixed point vs. double precision
+	double a1 = -ref.theta[0];
+	double ref_gain = ref.theta[1] / a1;
+	double ref_tau = RLS_DECIM * CYCLE_TIME / 1000.0 / a1;
+	double ref_ambient = RLS_T_REF / (double)FP_SCALE + ref.theta[2] / a1;
+	CHECK(fabs((double)gain / FP_SCALE - ref_gain) < 0.03 * ref_gain);
+	CHECK(fabs(tau - ref_tau) < 0.03 * ref_tau);
+	CHECK(fabs((double)ambient / FP_SCALE - ref_ambient) < 0.2);
+
+	// vs. the plant, the fit on window averages is a few % off
+	CHECK(abs(gain - FP(K)) < FP(K * 0.1));
+	CHECK(abs(tau - (int32_t)TAU) < TAU * 0.1);
+	CHECK(abs(ambient - FP(T_AMB)) < FP(1.0));
+
+	int32_t kp, ki;
+	CHECK(rls_gains(&kp, &ki));
+	CHECK(kp > 0 && ki > 0);
+}
+
+BENCH(rls_update, n)
+{
+	for (uint32_t i=0; i<n; i++)
+		rls_update(FP(25.0) + (i & 63), (i & 0x400) ? FP(200) : FP(50));
+}
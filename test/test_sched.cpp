@@ -0,0 +1,58 @@
+// Scheduler across the millis() overflow after 49 days. The test leaves
+// its own task table behind, setup() installs the firmware's again.
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include "hal.h"
+#include "sched.h"
+#include "runner.h"
+
+#define T_WRAP (1ULL << 32)  // [ms]
+
+static uint32_t first, last;  // releases of the slow task
+static uint32_t n_slow, n_fast, n_bad;
+
+// runs for 3 ms and makes the fast task late. It comes first in the table,
+// so it starts on time: every t0 + 5 + k * 10 ms
+// unsigned long is 64 bit on the host, 32 bit differences wrap like on
+// the AVR
+static void slow(unsigned long ts_now)
+{
+	if (n_slow++ == 0)
+		first = ts_now;
+	else if ((uint32_t)(ts_now - last) != 10)
+		n_bad++;
+	last = ts_now;
+	hal_advance_us(3000);
+}
+
+static void fast(unsigned long ts_now)
+{
+	n_fast++;
+}
+
+static const struct task tasks[] PROGMEM = {
+	{slow, 10, 5, 10, "slow"},
+	{fast, 2, 0, 5, "fast"},
+};
+
+TEST(sched_millis_wrap)
+{
+	// 2 s before the overflow
+	hal_set_time_us((T_WRAP - 2000) * 1000);
+	unsigned long t0 = millis();
+	sched_init(tasks, 2, t0);
+
+	n_slow = n_fast = n_bad = 0;
+	while (hal_time_us() < (T_WRAP + 2000) * 1000) {
+		sched_run(millis());
+		hal_advance_us(100);
+	}
+
+	CHECK(millis() < 3000);
+	CHECK_EQ(first, (uint32_t)(t0 + 5));
+	CHECK_EQ(n_bad, 0);
+	CHECK_EQ(n_slow, 400);
+	// the fast task starts up to 3 ms late but is released every 2 ms,
+	// no period is lost
+	CHECK(n_fast >= 1999 && n_fast <= 2000);
+}
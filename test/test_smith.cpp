@@ -0,0 +1,139 @@
+// Smith predictor of the probe loop on the first order plus dead time plant
+// it models: a set-point step settles without overshoot, the integrator
+// removes the offset of the fermentation heat, a wrong model still works
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include "pid.h"
+#include "ee_store.h"
+#include "temp_sensor.h"
+#include "ow_timer.h"
+#include "uart_log.h"
+#include "telemetry.h"
+#include "autotune.h"
+#include "rls.h"
+#include "kalman.h"
+#include "hist.h"
+#include "prof.h"
+#include "print.h"
+#include "main.h"
+#include "runner.h"
+
+// PROBE_SMITH is off in the firmware, the loop is built here a second
+// time with it. Without the dither, no second Timer2 ISR.
+#define PROBE_SMITH
+#undef HEATER_DITHER
+namespace sp {
+#include "../src/pid.cpp"
+}
+
+#define DT (CYCLE_TIME / 1000.0)  // [s]
+#define DEAD (PROBE_DEAD * 1000L / CYCLE_TIME)  // [cycles]
+
+// tempeh temperature, air temperature on its way into the tempeh. The air
+// loop is fast enough to follow the set-point at once.
+struct plant {
+	double tau;
+	int delay;  // [cycles]
+	double heat;  // fermentation, steady state offset [degC]
+	double t;  // [degC]
+	double air[2 * DEAD + 1];
+};
+
+static void plant_init(struct plant *pl, double tau, int delay, double t)
+{
+	memset(pl, 0, sizeof(*pl));
+	pl->tau = tau;
+	pl->delay = delay;
+	pl->t = t;
+	for (int i=0; i<delay + 1; i++)
+		pl->air[i] = t;
+}
+
+static void plant_step(struct plant *pl, double air)
+{
+	memmove(pl->air + 1, pl->air, pl->delay * sizeof(pl->air[0]));
+	pl->air[0] = air;
+	pl->t += DT / pl->tau * (pl->air[pl->delay] + pl->heat - pl->t);
+}
+
+// runs the loop for n cycles, returns the highest reading
+static double run(struct plant *pl, long n)
+{
+	double t_max = pl->t;
+	for (long k=0; k<n; k++) {
+		sp::measured_probe_temperature = fp16::from_raw(lround(pl->t * FP_SCALE));
+		sp::pid_probe_step();
+		plant_step(pl, sp::target_air_temperature.raw / (double)FP_SCALE);
+		if (pl->t > t_max)
+			t_max = pl->t;
+	}
+	return t_max;
+}
+
+// starts in steady state at 30 degC
+static void start(struct plant *pl, double tau, int delay)
+{
+	plant_init(pl, tau, delay, 30);
+	sp::target_probe_temperature = fp16::from(30);
+	sp::probe_i_val = fp32_i8::from(30);
+	sp::model_valid = false;
+	run(pl, 1);
+}
+
+TEST(smith_step)
+{
+	static struct plant pl;
+	start(&pl, PROBE_TAU, DEAD);
+
+	// 1 degC up: no overshoot, in 0.05 degC after 2 h
+	sp::target_probe_temperature = fp16::from(31);
+	double t_max = run(&pl, 2 * 3600 / DT);
+	CHECK(t_max < 31.02);
+	CHECK(fabs(pl.t - 31) < 0.05);
+	t_max = run(&pl, 2 * 3600 / DT);
+	CHECK(t_max < 31.02);
+	CHECK(fabs(pl.t - 31) < 0.02);
+
+	// the culture heats by 3 degC, the integrator takes the air down
+	pl.heat = 3;
+	t_max = run(&pl, 8 * 3600 / DT);
+	CHECK(fabs(pl.t - 31) < 0.02);
+	CHECK(fabs(sp::target_air_temperature.raw / (double)FP_SCALE - 28) < 0.05);
+	// and the set-point stays within the limits
+	CHECK(sp::target_air_temperature.raw >= AIR_MIN_LIMIT);
+}
+
+// runs for n cycles, the reading stays within lo ... hi
+static bool within(struct plant *pl, long n, double lo, double hi)
+{
+	bool in = true;
+	for (long k=0; k<n; k++) {
+		run(pl, 1);
+		in = in && pl->t > lo && pl->t < hi;
+	}
+	return in;
+}
+
+TEST(smith_model_error)
+{
+	static struct plant pl;
+	// the real box is faster, or has twice the dead time
+	const struct {
+		double tau;
+		int delay;
+	} plants[] = {{PROBE_TAU / 2, DEAD}, {PROBE_TAU, 2 * DEAD}};
+
+	for (auto &p : plants) {
+		start(&pl, p.tau, p.delay);
+		sp::target_probe_temperature = fp16::from(31);
+		double t_max = run(&pl, 4 * 3600 / DT);
+		CHECK(t_max < 31.7);
+		// the mismatch leaves a slow oscillation of about 0.1 degC, it
+		// doesn't grow
+		CHECK(within(&pl, 20 * 3600 / DT, 30.85, 31.15));
+	}
+}
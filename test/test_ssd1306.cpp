@@ -0,0 +1,135 @@
+// Dirty tracking and content scroll of the SSD1306 driver against the
+// display RAM model of the native HAL: only the columns which were drawn
+// go over the bus
+#include <string.h>
+#include "hal.h"
+#include "ssd1306.h"
+#include "runner.h"
+
+#ifndef SSD_PAGE_MODE
+#define UNTOUCHED 0xA5
+
+extern uint8_t *g_frameBuff;
+
+// sends what is dirty, then marks the display RAM
+static void start()
+{
+	ssd_send();
+	ssd_wait();
+	memset(hal_gddram, UNTOUCHED, sizeof(hal_gddram));
+}
+
+// columns x0 .. x1 of pages p0 .. p1 were sent, nothing else
+static unsigned n_outside(uint8_t p0, uint8_t p1, uint8_t x0, uint8_t x1)
+{
+	unsigned n = 0;
+	for (uint8_t p=0; p<8; p++) {
+		for (uint8_t x=0; x<DISPLAY_WIDTH; x++) {
+			bool in = p >= p0 && p <= p1 && x >= x0 && x <= x1;
+			uint8_t fb = g_frameBuff[p * DISPLAY_WIDTH + x];
+			n += hal_gddram[p][x] != (in ? fb : UNTOUCHED);
+		}
+	}
+	return n;
+}
+
+TEST(ssd_dirty_columns)
+{
+	// one page, columns 40 .. 49
+	start();
+	fillRect(40, 49, 8, 15, true);
+	ssd_send();
+	ssd_wait();
+	CHECK_EQ(n_outside(1, 1, 40, 49), 0);
+	// the next frame reports the bytes of this one: window command,
+	// prefixes and 10 columns
+	ssd_send();
+	CHECK_EQ(ssd_bytes_sent, 7 + 3 + 10);
+	ssd_wait();
+	ssd_send();
+	CHECK_EQ(ssd_bytes_sent, 0);
+
+	// across a page boundary, only the column range of each page
+	start();
+	setPixel(100, 23, true);
+	setPixel(103, 24, true);
+	ssd_send();
+	ssd_wait();
+	unsigned n_sent = 0;
+	for (uint8_t p=0; p<8; p++)
+		for (uint8_t x=0; x<DISPLAY_WIDTH; x++)
+			n_sent += hal_gddram[p][x] != UNTOUCHED;
+	CHECK_EQ(n_sent, 2);
+	CHECK_EQ(hal_gddram[2][100], g_frameBuff[2 * DISPLAY_WIDTH + 100]);
+	CHECK_EQ(hal_gddram[3][103], g_frameBuff[3 * DISPLAY_WIDTH + 103]);
+
+	fill(false);
+	ssd_send();
+	ssd_wait();
+}
+
+// bytes of the display RAM which differ from the framebuffer
+static unsigned n_differ()
+{
+	unsigned n = 0;
+	for (uint8_t p=0; p<8; p++)
+		for (uint8_t x=0; x<DISPLAY_WIDTH; x++)
+			n += hal_gddram[p][x] != g_frameBuff[p * DISPLAY_WIDTH + x];
+	return n;
+}
+
+// the display scrolls a region of pages 2 .. 4, columns 10 .. 40 by
+// itself, only the new column goes over the bus. The framebuffer follows.
+TEST(ssd_content_scroll)
+{
+	const uint8_t p0 = 2, p1 = 4, x0 = 10, x1 = 40;
+	const unsigned n_steps = 2 * (x1 - x0 + 1) + 5;
+
+	start();
+	for (uint8_t y=0; y<DISPLAY_HEIGHT; y++)
+		for (uint8_t x=0; x<DISPLAY_WIDTH; x++)
+			setPixel(x, y, (x * 7 + y * 3) % 5 == 0);
+	ssd_send();
+	ssd_wait();
+	CHECK_EQ(n_differ(), 0);
+	ssd_send();
+	ssd_wait();
+
+	// what the display should show
+	static uint8_t ref[8][DISPLAY_WIDTH];
+	memcpy(ref, hal_gddram, sizeof(ref));
+
+	ssd_scroll_setup(p0, p1, x0, x1);
+	unsigned n_bad = 0, n_fb = 0;
+	for (unsigned i=0; i<n_steps; i++) {
+		const uint8_t bits[] = {(uint8_t)i, (uint8_t)(i ^ 0x55), (uint8_t)~i};
+		ssd_scroll_step();
+		ssd_put_column(x1, bits);
+		ssd_wait();
+
+		for (uint8_t p=p0; p<=p1; p++) {
+			memmove(&ref[p][x0], &ref[p][x0 + 1], x1 - x0);
+			ref[p][x1] = bits[p - p0];
+		}
+		n_bad += memcmp(ref, hal_gddram, sizeof(ref)) != 0;
+		n_fb += n_differ();
+	}
+	CHECK_EQ(n_bad, 0);
+	CHECK_EQ(n_fb, 0);
+
+	// a window address, prefixes and 3 page bytes per column
+	ssd_send();
+	CHECK_EQ(ssd_bytes_sent, n_steps * (7 + 3 + 3));
+	ssd_wait();
+
+	// drawing over the scrolled region later sends the right bytes around
+	fillRect(x0 - 2, x0 + 3, 20, 27, true);
+	ssd_send();
+	ssd_wait();
+	CHECK_EQ(n_differ(), 0);
+
+	fill(false);
+	ssd_send();
+	ssd_wait();
+}
+#endif
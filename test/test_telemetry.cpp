@@ -0,0 +1,185 @@
+// Binary telemetry frames through the UART of the native HAL and back
+// through the decoder of tools/telemetry_decode.cpp
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include "hal.h"
+#include "telemetry.h"
+#include "uart_log.h"
+#include "print.h"
+#include "pid.h"
+#include "hatch.h"
+#include "temp_sensor.h"
+#include "main.h"
+#include "runner.h"
+
+// send_cobs() is static, the encoder is built here a second time
+namespace tm {
+#include "../src/telemetry.cpp"
+}
+
+#define TM_DECODE_LIB
+namespace dec {
+#include "../tools/telemetry_decode.cpp"
+}
+
+// serial output of f() as frames, split at the 0x00 delimiters
+static std::vector<std::vector<uint8_t> > capture(void (*f)())
+{
+	FILE *out = tmpfile();
+	hal_serial_out = out;
+	Serial.begin(115200);
+	log_blocking(true);
+	f();
+	for (int i=0; i<LOG_BUF_SIZE; i++) {
+		hal_advance_us(1000);
+		log_flush();
+	}
+	log_blocking(false);
+	hal_serial_out = stdout;
+
+	std::vector<std::vector<uint8_t> > frames(1);
+	rewind(out);
+	int c;
+	while ((c = fgetc(out)) != EOF) {
+		if (c != 0)
+			frames.back().push_back(c);
+		else if (!frames.back().empty())
+			frames.push_back(std::vector<uint8_t>());
+	}
+	fclose(out);
+	if (frames.back().empty())
+		frames.pop_back();
+	return frames;
+}
+
+static uint8_t data[255];
+static uint8_t data_len;
+
+static void send_data()
+{
+	tm::send_cobs(data, data_len);
+}
+
+static bool round_trip()
+{
+	std::vector<std::vector<uint8_t> > f = capture(send_data);
+	if (f.size() != 1)
+		return false;
+	uint8_t out[256];
+	int n = dec::cobs_decode(f[0], out, sizeof(out));
+	return n == data_len && memcmp(out, data, n) == 0;
+}
+
+// runs of non-zero bytes around the 254 byte limit of a COBS block
+TEST(telemetry_cobs)
+{
+	for (unsigned len=1; len<=255; len++) {
+		data_len = len;
+		// no zero at all
+		for (unsigned i=0; i<len; i++)
+			data[i] = 1 + i % 255;
+		CHECK(round_trip());
+		// a zero after every 254 bytes
+		for (unsigned i=254; i<len; i+=255)
+			data[i] = 0;
+		CHECK(round_trip());
+		// zeros at both ends and every 254 bytes from the start
+		for (unsigned i=0; i<len; i+=254)
+			data[i] = 0;
+		data[len - 1] = 0;
+		CHECK(round_trip());
+	}
+	// only zeros
+	memset(data, 0, sizeof(data));
+	data_len = sizeof(data);
+	CHECK(round_trip());
+}
+
+static struct telemetry sent;
+
+static void send_frame()
+{
+	tm::telemetry_binary = true;
+	tm::telemetry_send(&sent);
+}
+
+static void fill_frame()
+{
+	memset(&sent, 0, sizeof(sent));
+	sent.air = FP(31.25);
+	sent.air_set = FP(32);
+	sent.probe = FP(30.5);
+	sent.probe_set = FP(31);
+	sent.heater = 0x1200;
+	sent.air_p = -FP(0.75);
+	sent.air_i = FP(4);
+	sent.probe_i = 0x100;
+}
+
+// a real frame decodes to what was sent, no single bit error gets through
+TEST(telemetry_frame_crc)
+{
+	fill_frame();
+	std::vector<std::vector<uint8_t> > f = capture(send_frame);
+	CHECK_EQ(f.size(), 1);
+	if (f.size() != 1)
+		return;
+
+	struct telemetry t;
+	CHECK(dec::decode_frame(f[0], &t));
+	CHECK(memcmp(&t, &sent, sizeof(t)) == 0);
+
+	// the decoder sees the COBS bytes, flip every bit of the payload and
+	// the CRC which doesn't turn into a delimiter
+	unsigned n_flips = 0;
+	for (size_t i=0; i<f[0].size(); i++) {
+		for (uint8_t b=0; b<8; b++) {
+			std::vector<uint8_t> bad = f[0];
+			bad[i] ^= 1 << b;
+			if (bad[i] == 0)
+				continue;
+			CHECK(!dec::decode_frame(bad, &t));
+			n_flips++;
+		}
+	}
+	CHECK(n_flips > 8 * sizeof(t));
+
+	// the CRC itself corrupted, with the same COBS structure
+	uint8_t buf[sizeof(t) + 2];
+	CHECK_EQ(dec::cobs_decode(f[0], buf, sizeof(buf)), sizeof(buf));
+	buf[sizeof(t)] ^= 0x5A;
+	memcpy(data, buf, sizeof(buf));
+	data_len = sizeof(buf);
+	std::vector<std::vector<uint8_t> > g = capture(send_data);
+	CHECK_EQ(g.size(), 1);
+	CHECK(!dec::decode_frame(g[0], &t));
+}
+
+static void bench_send(uint32_t n, bool binary)
+{
+	fill_frame();
+	FILE *out = hal_serial_out;
+	hal_serial_out = NULL;
+	log_blocking(true);
+	tm::telemetry_binary = binary;
+	for (uint32_t i=0; i<n; i++) {
+		sent.uptime = i;
+		tm::telemetry_send(&sent);
+	}
+	log_blocking(false);
+	hal_serial_out = out;
+}
+
+// host time of a cycle log, up to the UART
+BENCH(telemetry_send, n)
+{
+	bench_send(n, true);
+}
+
+BENCH(telemetry_text, n)
+{
+	bench_send(n, false);
+}
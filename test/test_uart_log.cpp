@@ -0,0 +1,98 @@
+// The log buffer with the UART of the native HAL
+#include <string.h>
+#include <Arduino.h>
+#include "hal.h"
+#include "uart_log.h"
+#include "runner.h"
+
+// captures the serial output
+static FILE *capture()
+{
+	hal_serial_out = tmpfile();
+	Serial.begin(115200);
+	return hal_serial_out;
+}
+
+static void drain()
+{
+	for (int i=0; i<100; i++) {
+		hal_advance_us(5000);
+		log_flush();
+	}
+}
+
+static size_t captured(FILE *f, char *s, size_t size)
+{
+	fflush(f);
+	rewind(f);
+	size_t n = fread(s, 1, size - 1, f);
+	s[n] = 0;
+	fclose(f);
+	hal_serial_out = stdout;
+	return n;
+}
+
+TEST(log_blocking_nests)
+{
+	FILE *f = capture();
+	// setup() leaves blocking, like hist_print() inside a serial command
+	log_blocking(true);
+	log_blocking(true);
+	log_blocking(false);
+	for (int i=0; i<1000; i++)
+		log_putc('0' + i % 10);
+	log_blocking(false);
+	drain();
+
+	static char s[2000];
+	CHECK_EQ(captured(f, s, sizeof(s)), 1000);
+	CHECK_EQ(s[999], '9');
+}
+
+TEST(log_lost_marker)
+{
+	FILE *f = capture();
+	uint16_t dropped = log_dropped[LOG_INFO];
+	log_blocking(false);
+	for (int i=0; i<300; i++)
+		log_putc('a');
+	drain();
+	log_putc('b');
+	drain();
+	log_blocking(true);
+
+	static char s[400];
+	captured(f, s, sizeof(s));
+	CHECK_EQ(log_dropped[LOG_INFO] - dropped, 300 - (LOG_BUF_SIZE - 1));
+	CHECK_EQ(strspn(s, "a"), LOG_BUF_SIZE - 1);
+	CHECK(strcmp(s + LOG_BUF_SIZE - 1, "\n[173 bytes lost]\nb") == 0);
+}
+
+// the whole firmware: a serial command prints more than the buffer holds
+TEST(log_command_dump)
+{
+	FILE *f = capture();
+	setup();
+	for (int i=0; i<10000; i++) {
+		loop();
+		hal_advance_us(HAL_LOOP_US);
+	}
+	fflush(f);
+	long start = ftell(f);
+
+	hal_serial_input("s");
+	for (int i=0; i<10000; i++) {
+		loop();
+		hal_advance_us(HAL_LOOP_US);
+	}
+
+	static char s[8000];
+	size_t n = captured(f, s, sizeof(s));
+	CHECK(n > (size_t)start);
+	char *dump = strstr(s + start, "task ");
+	CHECK(dump != NULL);
+	if (dump) {
+		CHECK(strstr(dump, "\ninvert ") != NULL);
+		CHECK(strstr(dump, "lost]") == NULL);
+	}
+}
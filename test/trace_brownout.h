@@ -0,0 +1,66 @@
+// DS18B20 readings (raw, 1/16 degC) of air and probe as pid_cycle() got
+// them, one per second: tools/thermal_sim.cpp -t 0.1 -g 1, the warm-up
+// from 20 degC with a brown-out every minute, alternating between the
+// sensors. A brown-out reads as the power-on value 0x0550 (85.0 degC).
+static const int16_t trace_brownout[][2] = {
+	{320, 320}, {320, 320}, {320, 320}, {320, 320}, {320, 320}, {320, 320},
+	{320, 320}, {320, 320}, {320, 320}, {320, 320}, {320, 320}, {320, 320},
+	{320, 320}, {320, 320}, {320, 320}, {321, 320}, {321, 320}, {321, 320},
+	{321, 320}, {321, 320}, {321, 320}, {322, 320}, {322, 320}, {322, 320},
+	{322, 320}, {323, 320}, {323, 320}, {323, 320}, {323, 320}, {324, 320},
+	{324, 320}, {324, 320}, {325, 320}, {325, 320}, {325, 320}, {326, 320},
+	{326, 320}, {326, 320}, {327, 320}, {327, 320}, {328, 320}, {328, 320},
+	{328, 320}, {329, 320}, {329, 320}, {330, 320}, {330, 320}, {331, 320},
+	{331, 320}, {332, 320}, {332, 320}, {333, 320}, {333, 320}, {334, 320},
+	{334, 320}, {335, 320}, {335, 320}, {336, 320}, {336, 320}, {337, 320},
+	{337, 320}, {338, 1360}, {338, 320}, {339, 320}, {339, 320}, {340, 320},
+	{341, 320}, {341, 320}, {342, 320}, {342, 320}, {343, 320}, {344, 320},
+	{344, 320}, {345, 320}, {345, 320}, {346, 320}, {347, 320}, {347, 320},
+	{348, 320}, {349, 320}, {349, 320}, {350, 320}, {351, 320}, {351, 320},
+	{352, 320}, {352, 320}, {353, 320}, {354, 320}, {355, 320}, {355, 320},
+	{356, 320}, {357, 320}, {357, 320}, {358, 320}, {359, 320}, {359, 320},
+	{360, 320}, {361, 320}, {361, 320}, {362, 320}, {363, 320}, {364, 320},
+	{364, 320}, {365, 320}, {366, 320}, {366, 320}, {367, 320}, {368, 320},
+	{369, 320}, {369, 320}, {370, 320}, {371, 320}, {372, 320}, {372, 320},
+	{373, 320}, {374, 320}, {374, 320}, {375, 320}, {376, 320}, {377, 320},
+	{377, 320}, {1360, 320}, {379, 320}, {380, 320}, {380, 320}, {381, 320},
+	{382, 320}, {383, 320}, {384, 320}, {384, 320}, {385, 320}, {386, 320},
+	{387, 320}, {387, 320}, {388, 320}, {389, 320}, {390, 320}, {390, 320},
+	{391, 320}, {392, 320}, {393, 320}, {394, 320}, {394, 320}, {395, 320},
+	{396, 320}, {397, 320}, {397, 320}, {398, 320}, {399, 320}, {400, 320},
+	{401, 320}, {401, 320}, {402, 320}, {403, 320}, {404, 320}, {405, 320},
+	{405, 320}, {406, 320}, {407, 320}, {408, 320}, {408, 320}, {409, 320},
+	{410, 320}, {411, 320}, {412, 320}, {412, 320}, {413, 320}, {414, 320},
+	{415, 320}, {416, 320}, {416, 320}, {417, 320}, {418, 320}, {419, 320},
+	{420, 320}, {420, 320}, {421, 320}, {422, 320}, {423, 320}, {424, 320},
+	{424, 320}, {425, 1360}, {426, 320}, {427, 320}, {428, 320}, {428, 320},
+	{429, 320}, {430, 320}, {431, 320}, {431, 320}, {432, 320}, {433, 320},
+	{434, 320}, {435, 320}, {435, 320}, {436, 320}, {437, 320}, {438, 320},
+	{439, 320}, {439, 320}, {440, 320}, {441, 320}, {442, 320}, {443, 320},
+	{443, 320}, {444, 320}, {445, 320}, {446, 320}, {447, 320}, {447, 320},
+	{448, 320}, {449, 320}, {450, 320}, {451, 320}, {451, 320}, {452, 320},
+	{453, 320}, {454, 320}, {455, 320}, {455, 320}, {456, 320}, {457, 320},
+	{458, 320}, {458, 320}, {459, 320}, {460, 320}, {461, 320}, {462, 320},
+	{462, 320}, {463, 320}, {464, 320}, {465, 320}, {466, 320}, {466, 320},
+	{467, 320}, {468, 320}, {469, 320}, {470, 320}, {470, 320}, {471, 320},
+	{472, 320}, {1360, 320}, {473, 320}, {474, 320}, {475, 320}, {476, 320},
+	{477, 320}, {477, 320}, {478, 320}, {479, 320}, {480, 320}, {480, 320},
+	{481, 320}, {482, 320}, {483, 320}, {484, 320}, {484, 320}, {485, 320},
+	{486, 320}, {487, 320}, {487, 320}, {488, 320}, {489, 320}, {490, 320},
+	{491, 320}, {491, 320}, {492, 320}, {493, 320}, {494, 320}, {494, 320},
+	{495, 320}, {496, 320}, {497, 320}, {498, 320}, {498, 320}, {499, 320},
+	{500, 320}, {501, 320}, {501, 320}, {502, 320}, {503, 320}, {504, 320},
+	{504, 320}, {505, 320}, {506, 320}, {507, 320}, {507, 320}, {508, 320},
+	{509, 320}, {510, 320}, {511, 320}, {511, 320}, {512, 320}, {513, 320},
+	{514, 320}, {514, 320}, {515, 320}, {516, 320}, {517, 320}, {517, 320},
+	{518, 320}, {519, 1360}, {520, 320}, {520, 320}, {521, 320}, {522, 320},
+	{523, 320}, {523, 320}, {524, 320}, {525, 320}, {526, 320}, {526, 320},
+	{527, 320}, {528, 320}, {529, 320}, {529, 320}, {530, 320}, {531, 320},
+	{532, 320}, {532, 320}, {533, 320}, {534, 320}, {535, 320}, {535, 320},
+	{536, 320}, {537, 320}, {538, 320}, {538, 320}, {539, 320}, {540, 320},
+	{540, 320}, {541, 320}, {542, 320}, {543, 320}, {543, 320}, {544, 320},
+	{545, 320}, {546, 320}, {546, 320}, {547, 320}, {548, 320}, {549, 320},
+	{549, 320}, {550, 320}, {551, 320}, {551, 320}, {552, 320}, {553, 320},
+	{554, 320}, {554, 320}, {555, 320}, {556, 320}, {557, 320}, {557, 320},
+	{558, 320}, {559, 320}, {559, 320}, {560, 320}, {561, 320},
+};
@@ -0,0 +1,107 @@
+// Convert a capture of binary telemetry frames to CSV
+//
+//   g++ -O2 -Isrc -o telemetry_decode tools/telemetry_decode.cpp
+//   ./telemetry_decode < capture.bin > capture.csv
+//
+// Frames are COBS encoded struct telemetry + CRC16, delimited by 0x00.
+// Anything else on the line (text messages) is skipped.
+// test/test_telemetry.cpp builds this file without main() (TM_DECODE_LIB).
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "telemetry.h"
+#include "pid.h"
+
+// returns decoded length or -1 on a malformed frame
+static int cobs_decode(const std::vector<uint8_t> &in, uint8_t *out, size_t max_len)
+{
+	size_t i = 0, n = 0;
+	while (i < in.size()) {
+		uint8_t code = in[i++];
+		if (code == 0 || i + code - 1 > in.size())
+			return -1;
+		for (uint8_t k=1; k<code; k++) {
+			if (n >= max_len)
+				return -1;
+			out[n++] = in[i++];
+		}
+		// implicit zero, except at the end of the frame
+		if (code < 0xFF && i < in.size()) {
+			if (n >= max_len)
+				return -1;
+			out[n++] = 0;
+		}
+	}
+	return n;
+}
+
+// a COBS frame with a valid CRC and the known version
+static bool decode_frame(const std::vector<uint8_t> &frame, struct telemetry *t)
+{
+	uint8_t buf[sizeof(struct telemetry) + 2];
+	if (cobs_decode(frame, buf, sizeof(buf)) != sizeof(buf))
+		return false;  // most likely text output
+	uint16_t crc = buf[sizeof(*t)] | (buf[sizeof(*t) + 1] << 8);
+	memcpy(t, buf, sizeof(*t));
+	return crc == tm_crc16(buf, sizeof(*t)) && t->version == TELEMETRY_VERSION;
+}
+
+static double fp(int32_t v)
+{
+	return (double)v / FP_SCALE;
+}
+
+static void print_frame(const struct telemetry *t)
+{
+	printf("%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.4f,%d,%d,%d,%d\n",
+		t->uptime / 1000.0,
+		fp(t->air), fp(t->air_set),
+		fp(t->probe), fp(t->probe_set),
+		fp(t->heater),
+		fp(t->air_p), fp(t->air_i),
+		fp(t->probe_p), fp(t->probe_i) / 8,
+		t->hatch,
+		(t->flags & TM_HEATER_ENABLED) ? 1 : 0,
+		(t->flags & TM_DUAL) ? 1 : 0,
+		t->one_wire_error
+	);
+}
+
+#ifndef TM_DECODE_LIB
+int main(int argc, char **argv)
+{
+	FILE *f = stdin;
+	if (argc > 1 && (f = fopen(argv[1], "rb")) == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	printf("t,air,air_set,probe,probe_set,heater,air_p,air_i,probe_p,probe_i,hatch,heater_enabled,dual,one_wire_error\n");
+
+	std::vector<uint8_t> frame;
+	unsigned n_ok = 0, n_bad = 0;
+	int c;
+	while ((c = fgetc(f)) != EOF) {
+		if (c != 0) {
+			frame.push_back(c);
+			continue;
+		}
+		if (frame.empty())
+			continue;
+
+		struct telemetry t;
+		bool ok = decode_frame(frame, &t);
+		frame.clear();
+		if (!ok) {
+			n_bad++;
+			continue;
+		}
+		print_frame(&t);
+		n_ok++;
+	}
+
+	fprintf(stderr, "%u frames, %u skipped\n", n_ok, n_bad);
+	return 0;
+}
+#endif
@@ -0,0 +1,312 @@
+// Closed loop thermal simulator, runs the unmodified firmware through
+// the native HAL against a lumped model of the incubator.
+//
+//   pio run -e sim
+//   .pio/build/sim/program -t 48 -s 31
+//
+// Gains can be evaluated in batch by overriding them in the build flags:
+//   PLATFORMIO_BUILD_FLAGS='-DPROBE_KP=FP(20.0)' pio run -e sim
+//
+// Model, explicit Euler with SIM_DT steps:
+//   heater plate --> box air --> ambient (styrofoam and hatch)
+//                          \--> tempeh, through a transport delay
+//   the tempeh produces heat once the fermentation is going
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <Arduino.h>
+#include "hal.h"
+#include "pid.h"
+#include "hatch.h"
+#include "kalman.h"
+#include "main.h"
+#include "ssd1306.h"
+
+#define SIM_DT 0.1  // integration step [s]
+
+// time advanced per call of loop() [us]
+#define SIM_LOOP_US 1000
+
+// sensor index, the ROM search order with SWAP_SENSORS
+#define OW_PROBE 0
+#define OW_AIR 1
+
+// --------------------------------------------------------------
+//  Model parameters, -r varies them
+// --------------------------------------------------------------
+static double P_HEATER = 10.0;  // heater power at PWM 0xFF [W]
+static double C_PLATE = 100.0;  // [J / K]
+static double C_AIR = 50.0;
+static double C_TEMPEH = 3000.0;  // ~1 kg of soybeans
+static double G_PLATE_AIR = 0.5;  // [W / K]
+static double G_AIR_AMB = 0.15;
+static double G_HATCH = 0.4;  // with the hatch fully open
+static double G_AIR_TEMPEH = 0.5;
+static double P_FERM = 3.0;  // heat of fermentation [W]
+#define T_DELAY 600.0  // heat propagation into the tempeh [s]
+#define T_FERM_START (12 * 3600.0)  // ramping up over T_FERM_RAMP [s]
+#define T_FERM_RAMP (6 * 3600.0)
+
+// heat flow from the air into the tempeh, one entry per 10 s, it arrives
+// T_DELAY later
+#define N_DELAY ((int)(T_DELAY / 10))
+
+static double t_amb = 20.0;
+static double t_plate, t_air, t_tempeh;
+static double q_hist[N_DELAY];  // [W]
+static double q_sum = 0;  // [J] of the current entry
+static double t_sim = 0;  // [s]
+static double energy = 0;  // [J]
+
+// PWM duty integrated over the current model step [s]
+static double pwm_sum = 0, pwm_t = 0;
+
+static void model_step()
+{
+	// the PWM period is shorter than SIM_DT, use the mean duty
+	double pwm = pwm_t > 0 ? pwm_sum / pwm_t : OCR2B;
+	pwm_sum = pwm_t = 0;
+	double p_heat = heater_enabled ? P_HEATER * pwm / 255.0 : 0;
+	double g_amb = G_AIR_AMB + G_HATCH * hatch_pos() / MAX_HATCH;
+
+	double ramp = (t_sim - T_FERM_START) / T_FERM_RAMP;
+	double p_ferm = P_FERM * (ramp < 0 ? 0 : ramp > 1 ? 1 : ramp);
+
+	// heat reaching the tempeh, the oldest entry
+	int k = (int)(t_sim / 10);
+	double q_in = q_hist[(k + 1) % N_DELAY];
+
+	double q_pa = G_PLATE_AIR * (t_plate - t_air);
+	double q_at = G_AIR_TEMPEH * (t_air - t_tempeh);
+	double q_amb = g_amb * (t_air - t_amb);
+
+	t_plate += (p_heat - q_pa) / C_PLATE * SIM_DT;
+	t_air += (q_pa - q_amb - q_at) / C_AIR * SIM_DT;
+	t_tempeh += (q_in + p_ferm) / C_TEMPEH * SIM_DT;
+	q_sum += q_at * SIM_DT;
+
+	t_sim += SIM_DT;
+	energy += p_heat * SIM_DT;
+
+	// replaces the oldest entry
+	if ((int)(t_sim / 10) != k) {
+		q_hist[(k + 1) % N_DELAY] = q_sum / 10;
+		q_sum = 0;
+	}
+}
+
+// --------------------------------------------------------------
+//  Metrics
+// --------------------------------------------------------------
+static double band = 0.5;  // [degC]
+static double t_set;
+static double t_reached = -1;  // first time the set-point was reached
+static double t_settled = 0;  // last time the tempeh was out of band
+static double overshoot = 0;
+static double in_band = 0;  // [s]
+static double air_max = 0;
+
+// air temperature ripple: deviation from its 30 min average, in the
+// second half of the run
+static double t_ripple;
+static double air_avg = -1;
+static double ripple_sum = 0, ripple_t = 0;
+
+// error of the Kalman estimate of the tempeh, once it is valid
+static double kf_sum = 0, kf_t = 0, kf_max = 0;
+
+static FILE *csv = NULL;
+
+// start the auto-tuning by holding MID + UP at this time [s]
+static double t_tune = -1;
+
+// interval of sensor brown-outs [s], alternating between the sensors
+static double t_glitch = -1;
+static double t_next_glitch;
+static uint8_t n_glitch = 0;
+
+// defined in ssd1306.cpp
+extern uint8_t *g_frameBuff;
+
+// time to switch to the live chart [s], two short pushes of MID
+static double t_live = -1;
+
+static void tick(uint64_t t_us)
+{
+	static double t_last = 0;
+	static uint8_t ocr_last = 0;
+	pwm_sum += ocr_last * (t_us / 1e6 - t_last);
+	pwm_t += t_us / 1e6 - t_last;
+	t_last = t_us / 1e6;
+	ocr_last = OCR2B;
+
+	while (t_sim < t_us / 1e6) {
+		model_step();
+
+		double err = t_tempeh - t_set;
+		if (t_reached < 0 && err >= 0)
+			t_reached = t_sim;
+		if (t_reached >= 0 && err > overshoot)
+			overshoot = err;
+		if (err > band || err < -band)
+			t_settled = t_sim;
+		else
+			in_band += SIM_DT;
+		if (t_air > air_max)
+			air_max = t_air;
+		if (kalman_valid()) {
+			double e = kalman_tempeh().raw / (double)FP_SCALE - t_tempeh;
+			kf_sum += e * e * SIM_DT;
+			kf_t += SIM_DT;
+			if (fabs(e) > kf_max)
+				kf_max = fabs(e);
+		}
+
+		if (air_avg < 0)
+			air_avg = t_air;
+		air_avg += (t_air - air_avg) * SIM_DT / 1800;
+		if (t_sim >= t_ripple) {
+			ripple_sum += (t_air - air_avg) * (t_air - air_avg) * SIM_DT;
+			ripple_t += SIM_DT;
+		}
+
+		if (csv && (int)(t_sim * 10 + 0.5) % 600 == 0)
+			fprintf(csv, "%.0f,%.3f,%.3f,%.3f,%.3f,%d,%d\n",
+				t_sim, t_plate, t_air, t_tempeh,
+				target_air_temperature.raw / (double)FP_SCALE,
+				OCR2B, hatch_pos());
+	}
+
+	if (t_glitch > 0 && t_sim >= t_next_glitch) {
+		hal_ow_brownout(n_glitch++ % hal_ow_n);
+		t_next_glitch += t_glitch;
+	}
+
+	bool push = t_tune >= 0 && t_sim >= t_tune && t_sim < t_tune + 3.5;
+	hal_pin[PIN_MID] = hal_pin[PIN_UP] = push ? LOW : HIGH;
+	if (t_live >= 0 && ((t_sim >= t_live && t_sim < t_live + 0.1) ||
+	                    (t_sim >= t_live + 0.5 && t_sim < t_live + 0.6)))
+		hal_pin[PIN_MID] = LOW;
+
+	// DS18B20 resolution is 1/16 degC
+	if (hal_ow_n == 1) {
+		hal_ow_temp[0] = (int16_t)(t_air * 16 + 0.5);
+		return;
+	}
+	hal_ow_temp[OW_PROBE] = (int16_t)(t_tempeh * 16 + 0.5);
+	hal_ow_temp[OW_AIR] = (int16_t)(t_air * 16 + 0.5);
+}
+
+// the firmware's model constants are those of the defaults, this checks
+// how it copes with another box
+static void perturb(int seed)
+{
+	double *par[] = {&P_HEATER, &C_PLATE, &C_AIR, &C_TEMPEH, &G_PLATE_AIR,
+		&G_AIR_AMB, &G_HATCH, &G_AIR_TEMPEH, &P_FERM};
+	const int n = sizeof(par) / sizeof(par[0]);
+
+	srand(seed);
+	printf("model:");
+	for (int i=0; i<n; i++) {
+		*par[i] *= 0.7 + 0.6 * rand() / RAND_MAX;
+		printf(" %.3g", *par[i]);
+	}
+	printf("\n");
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-t hours] [-s set-point] [-a ambient] [-b band] "
+		"[-c trace.csv] [-u hours] [-g minutes] [-p hours] [-r seed] [-1] [-l]\n"
+		"  -u  start the auto-tuning after `hours`\n"
+		"  -g  brown out a sensor every `minutes`\n"
+		"  -p  show the live chart after `hours`, check the display at the end\n"
+		"  -r  vary each model parameter by up to +-30 %%, seeded\n"
+		"  -1  air sensor only\n"
+		"  -l  print the firmware log\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	double hours = 48;
+	t_set = 31.0;
+	hal_serial_out = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "t:s:a:b:c:u:g:p:r:1l")) != -1) {
+		switch (opt) {
+		case 't': hours = atof(optarg); break;
+		case 's': t_set = atof(optarg); break;
+		case 'a': t_amb = atof(optarg); break;
+		case 'b': band = atof(optarg); break;
+		case 'u': t_tune = atof(optarg) * 3600; break;
+		case 'g': t_glitch = t_next_glitch = atof(optarg) * 60; break;
+		case 'p': t_live = atof(optarg) * 3600; break;
+		case 'r': perturb(atoi(optarg)); break;
+		case '1': hal_ow_n = 1; break;
+		case 'l': hal_serial_out = stdout; break;
+		case 'c':
+			csv = fopen(optarg, "w");
+			if (!csv) {
+				perror(optarg);
+				return 1;
+			}
+			fprintf(csv, "t,plate,air,tempeh,air_set,pwm,hatch\n");
+			break;
+		default: usage(argv[0]);
+		}
+	}
+
+	t_ripple = hours * 3600 / 2;
+	t_plate = t_air = t_tempeh = t_amb;
+	for (int i=0; i<N_DELAY; i++)
+		q_hist[i] = 0;
+	tick(0);
+
+	setup();
+	target_probe_temperature = fp16::from(t_set);
+	hal_tick_hook = tick;
+
+	while (t_sim < hours * 3600) {
+		loop();
+		hal_advance_us(SIM_LOOP_US);
+	}
+
+	if (csv)
+		fclose(csv);
+
+	printf("run time:       %8.1f h\n", t_sim / 3600);
+	printf("set-point:      %8.2f degC\n", t_set);
+	if (t_reached < 0) {
+		printf("set-point not reached, tempeh at %.2f degC\n", t_tempeh);
+	} else {
+		printf("rise time:      %8.2f h\n", t_reached / 3600);
+		printf("overshoot:      %8.2f degC\n", overshoot);
+	}
+	printf("settling time:  %8.2f h (+-%.2f degC)\n", t_settled / 3600, band);
+	printf("time in band:   %8.1f %%\n", 100 * in_band / t_sim);
+	printf("max. air temp.: %8.2f degC\n", air_max);
+	printf("heater energy:  %8.1f Wh\n", energy / 3600);
+	printf("air ripple:     %8.3f degC rms\n", sqrt(ripple_sum / ripple_t));
+	if (kf_t > 0)
+		printf("kalman error:   %8.3f degC rms, %.3f max\n",
+			sqrt(kf_sum / kf_t), kf_max);
+
+	if (t_live >= 0) {
+		hal_ssd_dump(stdout);
+#ifndef SSD_PAGE_MODE
+		// the framebuffer is a full redraw of what the display should show
+		ssd_wait();
+		int n_diff = 0;
+		for (int i=0; i<DISPLAY_WIDTH * DISPLAY_HEIGHT / 8; i++)
+			n_diff += hal_gddram[i / DISPLAY_WIDTH][i % DISPLAY_WIDTH] != g_frameBuff[i];
+		printf("display vs. framebuffer: %d bytes differ\n", n_diff);
+		if (n_diff)
+			return 2;
+#endif
+	}
+	return 0;
+}